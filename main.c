@@ -28,7 +28,6 @@ Files created/used (in working directory):
 #define MCHARS_FILE "mistakes_chars.txt"
 
 #define WORDS_LIST_SIZE 200
-#define MAX_LINE 512
 #define TOP_N 10
 
 /* ----------------------
@@ -109,8 +108,9 @@ static int cmp_kc_desc(const void *a, const void *b) {
 static void load_map_from_file(Map *m, const char *filename) {
     FILE *f = fopen(filename, "r");
     if (!f) return; // no file yet
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), f)) {
+    char *line = NULL;   // getline grows the buffer, lines may be any length
+    size_t cap = 0;
+    while (getline(&line, &cap, f) >= 0) {
         char *tab = strchr(line, '\t');
         if (!tab) continue;
         *tab = '\0';
@@ -119,6 +119,7 @@ static void load_map_from_file(Map *m, const char *filename) {
         long cnt = atol(num);
         if (cnt != 0) map_add(m, key, cnt);
     }
+    free(line);
     fclose(f);
 }
 static void save_map_to_file(Map *m, const char *filename) {
@@ -196,11 +197,102 @@ typedef struct {
     size_t total_chars;
     size_t correct_words;
     size_t total_words;
+    size_t deleted_words;     // reference words that were skipped
+    size_t inserted_words;    // typed words with no counterpart in the reference
+    size_t substituted_words; // reference words typed as something else
 } CompareResult;
 
+/* ----------------------
+   Word alignment (Myers O(ND) diff on word hashes)
+   Pairs reference and typed words by shortest edit script instead of by position,
+   so one skipped or doubled word doesn't shift every later word.
+   ---------------------- */
+enum { ALIGN_MATCH, ALIGN_DELETE, ALIGN_INSERT };
+#define ALIGN_MAX_D 512 /* beyond this many differences fall back to positional compare */
+
+static size_t split_words(char *s, char ***out) {
+    size_t n = 0, cap = 16;
+    char **w = malloc(cap * sizeof(char*));
+    char *save = NULL, *tok;
+    if (!w) { perror("malloc"); exit(1); }
+    for (tok = strtok_r(s, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        if (n == cap) {
+            cap *= 2;
+            w = realloc(w, cap * sizeof(char*));
+            if (!w) { perror("realloc"); exit(1); }
+        }
+        w[n++] = tok;
+    }
+    *out = w;
+    return n;
+}
+
+static unsigned long word_hash(const char *s) {
+    unsigned long h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+/* Fill ops (room for n+m entries) with the edit script from r to t.
+   Returns the op count, or -1 if more than ALIGN_MAX_D edits are needed. */
+static long align_words(char **r, size_t rn, char **t, size_t tn, unsigned char *ops) {
+    long n = (long)rn, m = (long)tn;
+    long dmax = (n + m < ALIGN_MAX_D) ? n + m : ALIGN_MAX_D;
+    long off = dmax + 1, d, k, x, y, nops = 0;
+    unsigned long *rh = malloc((rn + 1) * sizeof(unsigned long));
+    unsigned long *th = malloc((tn + 1) * sizeof(unsigned long));
+    long *v = malloc((size_t)(2 * dmax + 3) * sizeof(long));
+    /* trace keeps only the live diagonals -d..d of each step: row d starts at d*d, 2d+1 entries */
+    size_t trace_cap = 64;
+    long *trace = malloc(trace_cap * sizeof(long));
+    if (!rh || !th || !v || !trace) { perror("malloc"); exit(1); }
+    for (size_t i = 0; i < rn; ++i) rh[i] = word_hash(r[i]);
+    for (size_t i = 0; i < tn; ++i) th[i] = word_hash(t[i]);
+    v[off + 1] = 0;
+    for (d = 0; d <= dmax; ++d) {
+        for (k = -d; k <= d; k += 2) {
+            x = (k == -d || (k != d && v[off + k - 1] < v[off + k + 1])) ? v[off + k + 1] : v[off + k - 1] + 1;
+            y = x - k;
+            while (x < n && y < m && rh[x] == th[y] && strcmp(r[x], t[y]) == 0) { x++; y++; }
+            v[off + k] = x;
+            if (x >= n && y >= m) goto found;
+        }
+        if ((size_t)((d + 1) * (d + 1)) > trace_cap) {
+            while ((size_t)((d + 1) * (d + 1)) > trace_cap) trace_cap *= 2;
+            trace = realloc(trace, trace_cap * sizeof(long));
+            if (!trace) { perror("realloc"); exit(1); }
+        }
+        memcpy(trace + d * d, v + off - d, (size_t)(2 * d + 1) * sizeof(long));
+    }
+    nops = -1;
+    goto done;
+found:
+    x = n; y = m;
+    for (; d > 0; --d) {
+        long *prev = trace + (d - 1) * (d - 1) + (d - 1); /* prev[k] for k in -(d-1)..d-1 */
+        long pk, px, py;
+        k = x - y;
+        pk = (k == -d || (k != d && prev[k - 1] < prev[k + 1])) ? k + 1 : k - 1;
+        px = prev[pk];
+        py = px - pk;
+        while (x > px && y > py) { ops[nops++] = ALIGN_MATCH; x--; y--; }
+        ops[nops++] = (pk == k + 1) ? ALIGN_INSERT : ALIGN_DELETE;
+        x = px; y = py;
+    }
+    while (x > 0 && y > 0) { ops[nops++] = ALIGN_MATCH; x--; y--; }
+    for (k = 0; k < nops / 2; ++k) {
+        unsigned char tmp = ops[k];
+        ops[k] = ops[nops - 1 - k];
+        ops[nops - 1 - k] = tmp;
+    }
+done:
+    free(rh); free(th); free(v); free(trace);
+    return nops;
+}
+
 /* Compare reference and typed; update word/char mistake maps */
 static CompareResult compare_and_update(const char *ref, const char *typed, Map *mwords, Map *mchars) {
-    CompareResult res = {0, 0, 0, 0};
+    CompareResult res = {0, 0, 0, 0, 0, 0, 0};
     if (!ref) ref = "";
     if (!typed) typed = "";
     size_t rlen = strlen(ref);
@@ -225,21 +317,47 @@ static CompareResult compare_and_update(const char *ref, const char *typed, Map
     }
     // Word-level compare: split by spaces in ref and typed
     // We'll do a simple tokenization; for word tests ref is a single word anyway.
-    char ref_copy[MAX_LINE]; strncpy(ref_copy, ref, MAX_LINE-1); ref_copy[MAX_LINE-1]=0;
-    char typed_copy[MAX_LINE]; strncpy(typed_copy, typed, MAX_LINE-1); typed_copy[MAX_LINE-1]=0;
-    char *rptr = ref_copy, *tptr = typed_copy;
-    char *rtok, *ttok;
-    while ( (rtok = strtok_r(rptr, " \t", &rptr)) != NULL ) {
-        ttok = strtok_r(tptr, " \t", &tptr);
-        res.total_words++;
-        if (ttok && strcmp(rtok, ttok) == 0) {
-            res.correct_words++;
-        } else {
-            // record word mistake (target word)
-            map_add(mwords, rtok, 1);
+    char *ref_copy = strdup(ref);
+    char *typed_copy = strdup(typed);
+    if (!ref_copy || !typed_copy) { perror("strdup"); exit(1); }
+    char **rw, **tw;
+    size_t rn = split_words(ref_copy, &rw);
+    size_t tn = split_words(typed_copy, &tw);
+    unsigned char *ops = malloc(rn + tn + 1);
+    if (!ops) { perror("malloc"); exit(1); }
+    res.total_words = rn;
+    long nops = align_words(rw, rn, tw, tn, ops);
+    if (nops < 0) {
+        // too different to align: compare word k with word k
+        for (size_t k = 0; k < rn; ++k) {
+            if (k < tn && strcmp(rw[k], tw[k]) == 0) { res.correct_words++; continue; }
+            if (k < tn) res.substituted_words++; else res.deleted_words++;
+            map_add(mwords, rw[k], 1);
+        }
+        if (tn > rn) res.inserted_words = tn - rn;
+    } else {
+        // deletes and inserts between two matches pair up as substitutions
+        size_t i = 0;
+        long p = 0;
+        while (p < nops) {
+            if (ops[p] == ALIGN_MATCH) { res.correct_words++; i++; p++; continue; }
+            size_t del = 0, ins = 0;
+            for (; p < nops && ops[p] != ALIGN_MATCH; ++p) {
+                if (ops[p] == ALIGN_DELETE) del++; else ins++;
+            }
+            size_t pairs = (del < ins) ? del : ins;
+            for (size_t q = 0; q < del; ++q) map_add(mwords, rw[i + q], 1);
+            res.substituted_words += pairs;
+            res.deleted_words += del - pairs;
+            res.inserted_words += ins - pairs;
+            i += del;
         }
     }
-    // any remaining typed tokens beyond ref considered wrong; can count but not needed
+    free(ops);
+    free(rw);
+    free(tw);
+    free(ref_copy);
+    free(typed_copy);
     return res;
 }
 
@@ -354,6 +472,10 @@ static void start_practice(Map *mwords, Map *mchars) {
         if (cres.total_words > 0) {
             printf("  Words correct: %zu / %zu\n", cres.correct_words, cres.total_words);
         }
+        if (cres.deleted_words + cres.inserted_words + cres.substituted_words > 0) {
+            printf("  Skipped: %zu  Extra: %zu  Mistyped: %zu\n",
+                   cres.deleted_words, cres.inserted_words, cres.substituted_words);
+        }
         // Show character-level mismatches (simple)
         if (cres.correct_chars < cres.total_chars) {
             printf("  Mismatches (reference -> typed) at positions:\n");
@@ -1,22 +1,34 @@
 // TypingTrainer
 
 
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>   // gettimeofday()
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>    // Raw-Modus für die Live-Ansicht
+#include <unistd.h>
+#include <sys/ioctl.h>  // Terminalgrösse
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>   // mmap für Snapshots
+#include <sys/stat.h>
+#include <sys/file.h>  // flock für die gemeinsame Rangliste
+#include <poll.h>
+#include <sys/timerfd.h> // Takt für Tests auf Zeit
 
 // Konfigurationskonstanten
 #define STATS_FILE  "stats.txt"          // Datei für Sitzungsstatistiken
 #define MWORDS_FILE "mistakes_words.txt" // Datei für Wörterfehler
 #define MCHARS_FILE "mistakes_chars.txt" // Datei für Zeichenfehler
-#define MAX_LINE 512                     // Max. Zeilenlänge für Datei-I/O
 #define TOP_N 10                         // Anzahl der Top-Fehler zur Anzeige
 
-// Word bank für das üben einzelner Wörter
-static const char *word_bank[] = {
+// Word bank für das üben einzelner Wörter (Deutsch)
+static const char *de_word_bank[] = {
     "Haus","Baum","Wasser","Feuer","Erde","Luft","Himmel","Sonne","Mond","Stern",
     "Mensch","Tier","Freund","Strasse","Auto","Zug","Bus","Fahrrad","Schule","Lehrer",
     "Schüler","Buch","Papier","Stift","Computer","Tastatur","Maus","Bildschirm","Tisch","Stuhl",
@@ -29,10 +41,8 @@ static const char *word_bank[] = {
     "Hose","Jacke","Schuh","Tasche","Schlüssel","Telefon","Nachricht","Arbeitstag","Feierabend","Gesundheit"
 };
 
-static const size_t word_bank_count = sizeof(word_bank) / sizeof(word_bank[0]);
-
-// Sentence bank für das üben ganzer Sätze
-static const char *sentence_bank[] = {
+// Sentence bank für das üben ganzer Sätze (Deutsch)
+static const char *de_sentence_bank[] = {
     "Der schnelle braune Fuchs springt ueber den faulen Hund.",
     "Uebung macht den Meister und regelmaessiges Training bringt Erfolg.",
     "Schnelles Tippen erfordert zuerst Genauigkeit, dann folgt die Geschwindigkeit.",
@@ -54,73 +64,501 @@ static const char *sentence_bank[] = {
     "Je mehr du tippst, desto natuerlicher fuehlt es sich an.",
     "Achte beim Schreiben auf fluessige Bewegungen und gleichmaessigen Rhythmus."
 };
-static const size_t sentence_bank_count = sizeof(sentence_bank) / sizeof(sentence_bank[0]);
+
+// Englische Banks (aus main.c übernommen)
+static const char *en_word_bank[] = {
+    "the","quick","brown","fox","jumps","over","lazy","dog","keyboard","practice",
+    "function","variable","pointer","memory","array","string","compile","debug",
+    "project","program","structure","coding","computer","process","thread",
+    "input","output","speed","accuracy","challenge","training","exercise",
+    "typist","development","education","system","design","language","data",
+    "persistent","statistics","analysis","improve","learning","interface",
+    "session","record","history","mistake","correct","wrong","practice"
+};
+
+static const char *en_sentence_bank[] = {
+    "The quick brown fox jumps over the lazy dog.",
+    "Practice makes progress and consistent effort brings improvement.",
+    "Typing fast requires accuracy before speed will follow.",
+    "C programming teaches careful thinking about memory and behavior.",
+    "Focus on home row, keep your fingers relaxed and eyes on the screen."
+};
+
+#define BANK_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// ---------- Sprachpakete ----------
+// Pro Sprache werden Wortliste und Sätze beim Start zu einem Paket kompiliert: alle Wörter
+// (auch die Tokens der Sätze) bekommen über eine minimale perfekte Hashfunktion eine dichte
+// Nummer 0..n-1, die Sätze werden vorab in Wortnummern zerlegt. Die Wörter-Map zählt Wörter
+// aus dem Paket über ihre Nummer, nur unbekannte Wörter (z.B. aus Textdateien) über den String.
+
+typedef struct {
+    const char *name;
+    const char **words;
+    size_t nwords;
+    const char **sentences;
+    size_t nsentences;
+} LangSource;
+
+static const LangSource lang_sources[] = {
+    { "de", de_word_bank, BANK_SIZE(de_word_bank), de_sentence_bank, BANK_SIZE(de_sentence_bank) },
+    { "en", en_word_bank, BANK_SIZE(en_word_bank), en_sentence_bank, BANK_SIZE(en_sentence_bank) },
+};
+#define LANG_COUNT BANK_SIZE(lang_sources)
+
+typedef struct {
+    const char *text;
+    int32_t *ids;           // Wortnummer pro Token (gleiche Trennung wie collect_words)
+    size_t n;
+} LangSentence;
+
+typedef struct {
+    const char *name;
+    char **words;           // Wortnummer -> Wort
+    size_t nwords;
+    uint32_t *disp;         // Verschiebung pro Bucket der perfekten Hashfunktion
+    size_t nbuckets;
+    int32_t *bank;          // Wortnummern der Wortübung
+    size_t bank_n;
+    LangSentence *sentences;
+    size_t sentence_n;
+} LangPack;
+
+static LangPack lang;       // Paket der gewählten Sprache (--lang)
+
+// FNV-1a mit Seed und Nachmischen (fmix32), damit verschiedene Seeds unabhängige Werte liefern
+static uint32_t lang_hash(const char *key, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Wortnummer im Paket, -1 für Wörter ausserhalb des Vokabulars
+static int32_t lang_word_id(const LangPack *p, const char *key) {
+    uint32_t id;
+    if (p->nwords == 0) return -1;
+    id = lang_hash(key, p->disp[lang_hash(key, 0) % p->nbuckets]) % (uint32_t)p->nwords;
+    return (strcmp(p->words[id], key) == 0) ? (int32_t)id : -1;
+}
 
 // Einfache map struct zum Zählen von Schlüsselhäufigkeiten (z.B. Fehler)
 typedef struct {
     char *key;
     long count;
+    long err;            // nur bei begrenzter Map: count kann um höchstens err zu hoch sein
 } KeyCount;
 
+// Items liegen in Einfügereihenfolge im Array, dazu ein Hash-Index (offene Adressierung, lineares Sondieren)
+// damit map_add nicht mehr alle Einträge durchsuchen muss.
 typedef struct {
     KeyCount *items;
     size_t n;
+    size_t cap;
+    int items_owned;     // 0 = items zeigt in den Snapshot (erst beim Vergrössern kopieren)
+    uint32_t *index;     // Slot -> Item-Nummer + 1, 0 = leer
+    size_t index_cap;    // Anzahl Slots (Zweierpotenz)
+    int index_owned;     // 0 = index zeigt in den Snapshot
+    void *snap;          // gemappter Snapshot (Keys zeigen hinein, nicht einzeln freigeben)
+    size_t snap_len;
+    const LangPack *pack; // Wörter aus diesem Paket werden über die Wortnummer gezählt
+    uint32_t *by_id;     // Wortnummer -> Item-Nummer + 1, 0 = noch nicht nachgeschlagen
+    size_t limit;        // > 0: höchstens limit Keys (Space-Saving), siehe map_set_limit
+    size_t *heap;        // Min-Heap der Item-Nummern nach count (nur mit limit)
+    size_t *heap_pos;    // Item-Nummer -> Position im Heap
+    double half_life;    // > 0: Zähler verfallen mit dieser Halbwertszeit in Sekunden, siehe map_weight
+    time_t landmark;     // Bezugszeit der gespeicherten Zähler
+    double weight;       // Gewicht eines neuen Fehlers zur Zeit weight_at
+    time_t weight_at;
 } Map;
 
+// Kopie eines Strings auf dem Heap
+static char *dup_string(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = (char*)malloc(len);
+    if (copy == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    memcpy(copy, s, len);
+    return copy;
+}
+
 // Map initialisieren
 static void map_init(Map *m) {
     m->items = NULL;
     m->n = 0;
+    m->cap = 0;
+    m->items_owned = 1;
+    m->index = NULL;
+    m->index_cap = 0;
+    m->index_owned = 1;
+    m->snap = NULL;
+    m->snap_len = 0;
+    m->pack = NULL;
+    m->by_id = NULL;
+    m->limit = 0;
+    m->heap = NULL;
+    m->heap_pos = NULL;
+    m->half_life = 0.0;
+    m->landmark = 0;
+    m->weight = 1.0;
+    m->weight_at = 0;
+}
+
+// Liegt der Key im gemappten Snapshot?
+static int map_key_in_snap(const Map *m, const char *key) {
+    const char *base = (const char*)m->snap;
+    return base != NULL && key >= base && key < base + m->snap_len;
 }
 
 // Map freigeben
 static void map_free(Map *m) {
     size_t i;
     for (i = 0; i < m->n; i++) {
-        free(m->items[i].key);
+        if (!map_key_in_snap(m, m->items[i].key)) free(m->items[i].key);
     }
-    free(m->items);
-    m->items = NULL;
-    m->n = 0;
+    if (m->items_owned) free(m->items);
+    if (m->index_owned) free(m->index);
+    if (m->snap != NULL) munmap(m->snap, m->snap_len);
+    free(m->by_id);
+    free(m->heap);
+    free(m->heap_pos);
+    map_init(m);
 }
 
-// Key zur Map hinzufügen/Zähler erhöhen
-static void map_add(Map *m, const char *key, long delta) {
+// Wörter aus dem Sprachpaket ab jetzt über die Wortnummer zählen
+static void map_use_pack(Map *m, const LangPack *p) {
+    free(m->by_id);
+    m->pack = p;
+    m->by_id = calloc(p->nwords + 1, sizeof(uint32_t));
+    if (m->by_id == NULL) {
+        printf("Fehler bei calloc\n");
+        exit(1);
+    }
+}
+
+// Zeitlicher Verfall der Zähler: mit --decay DAYS zählt ein Fehler nach DAYS Tagen nur noch halb.
+// Statt alle Zähler regelmässig zu verkleinern, werden neue Fehler stärker gewichtet (Forward Decay):
+// gespeichert wird count = Summe delta * DECAY_UNIT * 2^((t - landmark) / half_life). Der aktuelle
+// Wert ist count / map_weight(jetzt), für alle Keys derselbe Teiler. Die Reihenfolge (Sortierung,
+// Heap der begrenzten Map) gilt also unverändert und jedes Update bleibt O(1). Nur wenn das Gewicht
+// zu gross wird (nach DECAY_REBASE Halbwertszeiten) oder sich die Halbwertszeit ändert, werden die
+// Zähler einmal umgerechnet und die Bezugszeit nachgezogen.
+// Die .txt Datei enthält die aktuellen Werte (count / Gewicht beim Speichern, mit Nachkommastellen),
+// bleibt also im gemeinsamen Format mit main.c und dem Merge. Halbwertszeit und Bezugszeit der
+// gespeicherten Zähler stehen daneben in einer eigenen Datei (z.B. mistakes_words.decay); die
+// Bezugszeit gilt für den Snapshot, beim Parsen der .txt ist die mtime der Datei die Bezugszeit.
+
+#define DECAY_UNIT 256.0        // Auflösung: ein frischer Fehler zählt intern 256
+#define DECAY_REBASE 16.0       // Gewicht höchstens DECAY_UNIT * 2^16, Zähler bleiben weit unter LONG_MAX
+#define DECAY_EXT ".decay"
+
+static double decay_half_life = -1.0;   // --decay in Sekunden (0 = aus, < 0 = wie in der Datei gespeichert)
+
+// 2^x ohne libm (Ganzzahlteil durch Verdoppeln, Rest als Reihe von e^(x ln 2))
+static double exp2_approx(double x) {
+    double r = 1.0;
+    double f;
+    while (x >= 1.0) {
+        r *= 2.0;
+        x -= 1.0;
+    }
+    while (x < 0.0) {
+        r /= 2.0;
+        x += 1.0;
+    }
+    f = x * 0.6931471805599453;
+    return r * (1.0 + f * (1.0 + f / 2.0 * (1.0 + f / 3.0 * (1.0 + f / 4.0 * (1.0 + f / 5.0 * (1.0 + f / 6.0))))));
+}
+
+// Alle Zähler mit factor multiplizieren (Reihenfolge bleibt erhalten, der Heap muss nicht neu sortiert werden)
+static void map_rescale(Map *m, double factor) {
     size_t i;
-    if (key == NULL) {
-        return;
+    for (i = 0; i < m->n; i++) {
+        m->items[i].count = (long)((double)m->items[i].count * factor + 0.5);
+        m->items[i].err = (long)((double)m->items[i].err * factor + 0.5);
     }
+}
 
-    // Prüfen, ob key bereits existiert
+// Zähler auf ihren Wert von jetzt umrechnen, jetzt wird die neue Bezugszeit (ein Durchgang über alle Keys)
+static void map_decay_rebase(Map *m, double half_life) {
+    time_t now = time(NULL);
+    double w_old = 1.0;
+    double w_new = (half_life > 0.0) ? DECAY_UNIT : 1.0;
+    if (m->half_life > 0.0 && now > m->landmark) {
+        w_old = DECAY_UNIT * exp2_approx((double)(now - m->landmark) / m->half_life);
+    } else if (m->half_life > 0.0) {
+        w_old = DECAY_UNIT;
+    }
+    if (w_old != w_new) map_rescale(m, w_new / w_old);
+    m->half_life = half_life;
+    m->landmark = now;
+    m->weight = w_new;
+    m->weight_at = now;
+}
+
+// Verfall ein- oder ausschalten bzw. die Halbwertszeit ändern. Ausschalten friert die aktuellen Werte ein.
+// Bei gleicher Halbwertszeit bleiben Zähler und Bezugszeit aus der Datei unverändert.
+static void map_set_decay(Map *m, double half_life) {
+    if (half_life == m->half_life) return;
+    map_decay_rebase(m, half_life);
+}
+
+// Gewicht eines Fehlers, der jetzt passiert (1 ohne Verfall). Wird höchstens einmal pro Sekunde neu berechnet
+static double map_weight(Map *m) {
+    time_t now;
+    double x;
+    if (m->half_life <= 0.0) return 1.0;
+    now = time(NULL);
+    if (now == m->weight_at) return m->weight;
+    x = (now > m->landmark) ? (double)(now - m->landmark) / m->half_life : 0.0;
+    if (x >= DECAY_REBASE) {
+        map_decay_rebase(m, m->half_life);
+        return m->weight;
+    }
+    m->weight = DECAY_UNIT * exp2_approx(x);
+    m->weight_at = now;
+    return m->weight;
+}
+
+// delta in gespeicherte Einheiten umrechnen
+static long map_scaled(Map *m, long delta) {
+    if (m->half_life <= 0.0) return delta;
+    return (long)((double)delta * map_weight(m) + (delta >= 0 ? 0.5 : -0.5));
+}
+
+// Aktueller (verfallener) Wert eines gespeicherten Zählers
+static double map_value(const Map *m, long count) {
+    time_t now;
+    if (m->half_life <= 0.0) return (double)count;
+    now = time(NULL);
+    return (double)count / (DECAY_UNIT * exp2_approx(now > m->landmark ? (double)(now - m->landmark) / m->half_life : 0.0));
+}
+
+// Zähler für die Anzeige: ganzzahlig ohne Verfall, sonst mit einer Nachkommastelle
+static const char *map_count_text(const Map *m, long count, char *buf, size_t size) {
+    if (m == NULL || m->half_life <= 0.0) snprintf(buf, size, "%ld", count);
+    else snprintf(buf, size, "%.1f", map_value(m, count));
+    return buf;
+}
+
+// FNV-1a Hash über den Key (wird auch im Snapshot-Index verwendet, nicht ändern ohne SNAP_VERSION)
+static uint32_t key_hash(const char *key) {
+    uint32_t h = 2166136261u;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Hash-Index mit cap Slots neu aufbauen
+static void map_index_rebuild(Map *m, size_t cap) {
+    size_t i;
+    uint32_t *idx = calloc(cap, sizeof(uint32_t));
+    if (idx == NULL) {
+        printf("Fehler bei calloc\n");
+        exit(1);
+    }
     for (i = 0; i < m->n; i++) {
-        if (strcmp(m->items[i].key, key) == 0) {
-            m->items[i].count += delta;
-            return;
+        size_t s = key_hash(m->items[i].key) & (cap - 1);
+        while (idx[s] != 0) s = (s + 1) & (cap - 1);
+        idx[s] = (uint32_t)(i + 1);
+    }
+    if (m->index_owned) free(m->index);
+    m->index = idx;
+    m->index_cap = cap;
+    m->index_owned = 1;
+}
+
+// Item-Nummer zum Key suchen, -1 wenn nicht vorhanden
+static long map_find(const Map *m, const char *key) {
+    size_t s;
+    if (m->index_cap == 0) return -1;
+    s = key_hash(key) & (m->index_cap - 1);
+    while (m->index[s] != 0) {
+        size_t i = m->index[s] - 1;
+        if (strcmp(m->items[i].key, key) == 0) return (long)i;
+        s = (s + 1) & (m->index_cap - 1);
+    }
+    return -1;
+}
+
+// Min-Heap über count für den begrenzten Modus
+static void map_heap_swap(Map *m, size_t a, size_t b) {
+    size_t t = m->heap[a];
+    m->heap[a] = m->heap[b];
+    m->heap[b] = t;
+    m->heap_pos[m->heap[a]] = a;
+    m->heap_pos[m->heap[b]] = b;
+}
+
+static void map_heap_up(Map *m, size_t p) {
+    while (p > 0 && m->items[m->heap[p]].count < m->items[m->heap[(p - 1) / 2]].count) {
+        map_heap_swap(m, p, (p - 1) / 2);
+        p = (p - 1) / 2;
+    }
+}
+
+static void map_heap_down(Map *m, size_t p) {
+    while (1) {
+        size_t l = 2 * p + 1;
+        size_t best = p;
+        if (l < m->n && m->items[m->heap[l]].count < m->items[m->heap[best]].count) best = l;
+        if (l + 1 < m->n && m->items[m->heap[l + 1]].count < m->items[m->heap[best]].count) best = l + 1;
+        if (best == p) return;
+        map_heap_swap(m, p, best);
+        p = best;
+    }
+}
+
+// Item aus dem Hash-Index entfernen. Nachfolgende Einträge der Sondierkette werden zurückgeschoben,
+// damit map_find sie weiterhin findet
+static void map_index_remove(Map *m, size_t item) {
+    size_t mask = m->index_cap - 1;
+    size_t s = key_hash(m->items[item].key) & mask;
+    size_t j;
+    while (m->index[s] != item + 1) s = (s + 1) & mask;
+    j = s;
+    while (1) {
+        size_t home;
+        j = (j + 1) & mask;
+        if (m->index[j] == 0) break;
+        home = key_hash(m->items[m->index[j] - 1].key) & mask;
+        // Eintrag j darf nach s, wenn sein Heimatslot nicht (zyklisch) zwischen s und j liegt
+        if ((j > s && (home <= s || home > j)) || (j < s && home <= s && home > j)) {
+            m->index[s] = m->index[j];
+            s = j;
         }
     }
+    m->index[s] = 0;
+}
 
-    // Array um 1 Element vergrössern z.B. Erhöhung von Platz für 2 KeyCount Strukturen auf 3 KeyCount Strukturen (nur die für die Pointer)
-    KeyCount *tmp = realloc(m->items, (m->n + 1) * sizeof(KeyCount));
-    if (tmp == NULL) {
-        printf("Fehler bei realloc\n");
-        exit(1);
+// Zähler von Item i ändern (hält im begrenzten Modus den Heap aktuell)
+static void map_bump(Map *m, size_t i, long delta) {
+    delta = map_scaled(m, delta);
+    m->items[i].count += delta;
+    if (m->heap != NULL) {
+        if (delta >= 0) map_heap_down(m, m->heap_pos[i]);
+        else map_heap_up(m, m->heap_pos[i]);
     }
-    //Neuer Pointer übernehmen
-    m->items = tmp;
+}
 
-    //Speicher für Kopie von key reservieren, jetzt ist Platz für den neuen Eintrag
-    {
-        size_t len = strlen(key) + 1; //+1 wegen '\0'
-        m->items[m->n].key = (char*)malloc(len);
-        if (m->items[m->n].key == NULL) {
-            printf("Fehler bei malloc\n");
+// Begrenzte Map ist voll: key übernimmt den Eintrag mit dem kleinsten Zähler (Space-Saving)
+static size_t map_evict_min(Map *m, const char *key, long count) {
+    size_t i = m->heap[0];
+    size_t s;
+    long min = m->items[i].count;
+    if (m->pack != NULL) {
+        int32_t id = lang_word_id(m->pack, m->items[i].key);
+        if (id >= 0) m->by_id[id] = 0;
+    }
+    map_index_remove(m, i);
+    if (!map_key_in_snap(m, m->items[i].key)) free(m->items[i].key);
+    m->items[i].key = dup_string(key);
+    m->items[i].count = min + count;
+    m->items[i].err = min;
+    s = key_hash(key) & (m->index_cap - 1);
+    while (m->index[s] != 0) s = (s + 1) & (m->index_cap - 1);
+    m->index[s] = (uint32_t)(i + 1);
+    map_heap_down(m, 0);
+    return i;
+}
+
+// Neuen Key anhängen (key darf noch nicht in der Map sein), gibt die Item-Nummer zurück
+static size_t map_insert(Map *m, const char *key, long count) {
+    size_t s;
+
+    count = map_scaled(m, count);
+    if (m->limit > 0 && m->n >= m->limit) {
+        return map_evict_min(m, key, count);
+    }
+
+    // Array verdoppeln wenn voll (statt bei jedem Eintrag um 1 zu vergrössern)
+    if (m->n == m->cap) {
+        size_t newcap = (m->cap == 0) ? 8 : m->cap * 2;
+        KeyCount *tmp = realloc(m->items_owned ? m->items : NULL, newcap * sizeof(KeyCount));
+        if (tmp == NULL) {
+            printf("Fehler bei realloc\n");
             exit(1);
         }
-        strcpy(m->items[m->n].key, key);
+        if (!m->items_owned) {
+            // Items aus dem Snapshot übernehmen, das Mapping bleibt für die Keys bestehen
+            memcpy(tmp, m->items, m->n * sizeof(KeyCount));
+            m->items_owned = 1;
+        }
+        //Neuer Pointer übernehmen
+        m->items = tmp;
+        m->cap = newcap;
     }
+
+    //Speicher für Kopie von key reservieren, jetzt ist Platz für den neuen Eintrag
+    m->items[m->n].key = dup_string(key);
     //Zähler eintragen
-    m->items[m->n].count = delta;
+    m->items[m->n].count = count;
+    m->items[m->n].err = 0;
     m->n++;
+    if (m->heap != NULL) {
+        m->heap[m->n - 1] = m->n - 1;
+        m->heap_pos[m->n - 1] = m->n - 1;
+        map_heap_up(m, m->n - 1);
+    }
+
+    // Index höchstens zu 3/4 füllen
+    if (m->n * 4 > m->index_cap * 3) {
+        map_index_rebuild(m, (m->index_cap == 0) ? 16 : m->index_cap * 2);
+    } else if (!m->index_owned) {
+        map_index_rebuild(m, m->index_cap); // Index aus dem Snapshot nicht verändern
+    } else {
+        s = key_hash(key) & (m->index_cap - 1);
+        while (m->index[s] != 0) s = (s + 1) & (m->index_cap - 1);
+        m->index[s] = (uint32_t)m->n;
+    }
+    return m->n - 1;
+}
+
+// Zähler eines Worts aus dem Sprachpaket erhöhen: nach dem ersten Mal ein direkter Arrayzugriff
+static void map_add_id(Map *m, int32_t id, long delta) {
+    uint32_t slot = m->by_id[id];
+    if (slot == 0) {
+        const char *key = m->pack->words[id];
+        long found = map_find(m, key);
+        if (found < 0) found = (long)map_insert(m, key, 0);
+        slot = (uint32_t)found + 1;
+        m->by_id[id] = slot;
+    }
+    map_bump(m, slot - 1, delta);
+}
+
+// Key zur Map hinzufügen/Zähler erhöhen
+static void map_add(Map *m, const char *key, long delta) {
+    long found;
+    if (key == NULL) {
+        return;
+    }
+    if (m->pack != NULL) {
+        int32_t id = lang_word_id(m->pack, key);
+        if (id >= 0) {
+            map_add_id(m, id, delta);
+            return;
+        }
+    }
+
+    // Prüfen, ob key bereits existiert
+    found = map_find(m, key);
+    if (found >= 0) {
+        map_bump(m, (size_t)found, delta);
+        return;
+    }
+    map_insert(m, key, delta);
 }
 
 // Einzelner Char zur Map hinzufügen/Zähler erhöhen
@@ -140,438 +578,5759 @@ static int cmp_kc_desc(const void *a, const void *b) {
     return strcmp(A->key, B->key);
 }
 
-// Lade Map-Daten aus Datei (Format: "key\tcount\n")
-static void load_map_from_file(Map *m, const char *filename) {
-    FILE *f = fopen(filename, "r");
-    if (f == NULL) {
-        return; // File existiert nicht
-    }
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), f) != NULL) {
-        char *tab = strchr(line, '\t');
-        if (tab == NULL) continue;
-        *tab = '\0';
-        char *key = line;
-        char *num = tab + 1;
-        long cnt = atol(num);
-        if (cnt != 0) {
-            map_add(m, key, cnt);
+// Begrenzter Modus (Space-Saving, Metwally et al.): höchstens k Keys bei festem Speicher.
+// Ist die Map voll, übernimmt ein neuer Key den Eintrag mit dem kleinsten Zähler und erbt
+// dessen Wert als möglichen Fehler. Jeder count ist damit eine obere Schranke, höchstens um
+// err <= N/k zu hoch (N = Summe aller Zähler), und jedes Wort mit mehr als N/k Fehlern ist enthalten.
+static void map_set_limit(Map *m, size_t k) {
+    size_t i;
+    size_t cap = 16;
+    if (k == 0) return;
+    if (m->n > k) {
+        // nur die k grössten behalten
+        qsort(m->items, m->n, sizeof(KeyCount), cmp_kc_desc);
+        for (i = k; i < m->n; i++) {
+            if (!map_key_in_snap(m, m->items[i].key)) free(m->items[i].key);
         }
+        m->n = k;
+        if (m->by_id != NULL) memset(m->by_id, 0, m->pack->nwords * sizeof(uint32_t));
     }
-    fclose(f);
-}
-
-// Speichere Map-Daten in Datei (Format: "key\tcount\n")
-static void save_map_to_file(Map *m, const char *filename) {
-    FILE *f = fopen(filename, "w");
-    size_t i;
-    if (f == NULL) {
-        perror("fopen");
-        return;
+    // Index gleich für k Keys auslegen, danach wird er nie mehr neu aufgebaut
+    while (k * 4 > cap * 3) cap *= 2;
+    map_index_rebuild(m, cap);
+    m->limit = k;
+    m->heap = malloc(k * sizeof(size_t));
+    m->heap_pos = malloc(k * sizeof(size_t));
+    if (m->heap == NULL || m->heap_pos == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
     }
     for (i = 0; i < m->n; i++) {
-        fprintf(f, "%s\t%ld\n", m->items[i].key, m->items[i].count);
+        m->heap[i] = i;
+        m->heap_pos[i] = i;
     }
-    fclose(f);
+    for (i = m->n / 2; i-- > 0;) map_heap_down(m, i);
 }
 
-// Session-Statistiken anhängen (Format: "YYYY-MM-DDTHH:MM:SS,wpm,accuracy,chars\n")
-static void append_session_stats(double wpm, double accuracy, long chars) {
-    FILE *f = fopen(STATS_FILE, "a");
-    if (f == NULL) {
-        perror("fopen stats");
-        return;
+// Vergleichfunktion für qsort über KeyCount-Zeiger: aufsteigend nach key (Reihenfolge der .txt Dateien)
+static int cmp_kc_key(const void *a, const void *b) {
+    return strcmp((*(const KeyCount * const *)a)->key, (*(const KeyCount * const *)b)->key);
+}
+
+// ---------- Sprachpakete kompilieren ----------
+
+// Nächstes durch Leerraum getrenntes Token ab *s als neuer String, NULL am Ende
+static char *lang_next_token(const char **s) {
+    const char *p = *s;
+    const char *e;
+    char *tok;
+    while (*p && isspace((unsigned char)*p)) p++;
+    if (!*p) return NULL;
+    e = p;
+    while (*e && !isspace((unsigned char)*e)) e++;
+    tok = malloc((size_t)(e - p) + 1);
+    if (tok == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
     }
-    time_t t = time(NULL);
-    struct tm *tm_info = localtime(&t);
-    char buf[64];
-    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", tm_info);
-    fprintf(f, "%s,%.2f,%.2f,%ld\n", buf, wpm, accuracy, chars);
-    fclose(f);
+    memcpy(tok, p, (size_t)(e - p));
+    tok[e - p] = '\0';
+    *s = e;
+    return tok;
 }
 
-// Agregierte Statistiken berechnen
-static void compute_aggregate_stats(double *avg_wpm, double *best_wpm, double *avg_acc, size_t *sessions) {
-    FILE *f;
-    double wpm, acc;
-    long ch;
+typedef struct {
+    size_t bucket;
+    size_t size;
+} LangBucket;
 
-    *avg_wpm = 0.0;
-    *best_wpm = 0.0;
-    *avg_acc = 0.0;
-    *sessions = 0;
+static int cmp_bucket_desc(const void *a, const void *b) {
+    const LangBucket *A = (const LangBucket *)a;
+    const LangBucket *B = (const LangBucket *)b;
+    if (A->size != B->size) return (A->size < B->size) ? 1 : -1;
+    return (A->bucket < B->bucket) ? -1 : (A->bucket > B->bucket);
+}
 
-    f = fopen(STATS_FILE, "r"); //öffnen im read modus
-    if (f == NULL) {
-        return;
+// Minimale perfekte Hashfunktion (hash and displace): Wörter auf Buckets verteilen, dann für
+// jeden Bucket (grösste zuerst) eine Verschiebung suchen, bei der alle seine Wörter auf noch
+// freie Nummern fallen. Ergebnis: words[nummer] und disp[bucket].
+static void lang_build_hash(LangPack *p, const Map *vocab) {
+    size_t n = vocab->n;
+    size_t *first;
+    size_t *next;
+    unsigned char *taken;
+    uint32_t *slots;
+    LangBucket *order;
+    size_t i;
+
+    p->nwords = n;
+    p->nbuckets = n / 4 + 1;
+    p->words = calloc(n + 1, sizeof(char *));
+    p->disp = calloc(p->nbuckets, sizeof(uint32_t));
+    first = malloc(p->nbuckets * sizeof(size_t));
+    next = malloc((n + 1) * sizeof(size_t));
+    taken = calloc(n + 1, 1);
+    slots = malloc((n + 1) * sizeof(uint32_t));
+    order = calloc(p->nbuckets, sizeof(LangBucket));
+    if (p->words == NULL || p->disp == NULL || first == NULL || next == NULL || taken == NULL
+        || slots == NULL || order == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    // Buckets als verkettete Listen über die Vokabelnummern
+    for (i = 0; i < p->nbuckets; i++) {
+        first[i] = SIZE_MAX;
+        order[i].bucket = i;
     }
+    for (i = 0; i < n; i++) {
+        size_t b = lang_hash(vocab->items[i].key, 0) % p->nbuckets;
+        next[i] = first[b];
+        first[b] = i;
+        order[b].size++;
+    }
+    qsort(order, p->nbuckets, sizeof(LangBucket), cmp_bucket_desc);
 
-    //fscanf > gibt die Anzahl erfolgreich eingelesener Felder zurück
-    while (fscanf(f, "%*[^,],%lf,%lf,%ld\n", &wpm, &acc, &ch) == 3) { //Datum wird eingelesen (Kommas werden ignoriert) auser am Ende werden zwei Double und ein Long mit Kommatrennung und dann ein Zeilenumbruch
-        (*sessions)++;
-        *avg_wpm += wpm;
-        *avg_acc += acc;
-        if (wpm > *best_wpm) {
-            *best_wpm = wpm;
+    for (i = 0; i < p->nbuckets && order[i].size > 0; i++) {
+        size_t b = order[i].bucket;
+        uint32_t d;
+        for (d = 1; d != 0; d++) {
+            size_t k;
+            size_t placed = 0;
+            for (k = first[b]; k != SIZE_MAX; k = next[k]) {
+                uint32_t s = lang_hash(vocab->items[k].key, d) % (uint32_t)n;
+                if (taken[s]) break;
+                taken[s] = 1; // vorläufig, damit Wörter desselben Buckets nicht kollidieren
+                slots[placed++] = s;
+            }
+            if (k == SIZE_MAX) break;
+            while (placed > 0) taken[slots[--placed]] = 0;
+        }
+        if (d == 0) {
+            printf("Sprachpaket %s: keine perfekte Hashfunktion gefunden\n", p->name);
+            exit(1);
         }
+        p->disp[b] = d;
     }
-    fclose(f);
-
-    if (*sessions > 0) {
-        *avg_wpm /= (double)(*sessions);
-        *avg_acc /= (double)(*sessions);
+    for (i = 0; i < n; i++) {
+        const char *key = vocab->items[i].key;
+        uint32_t s = lang_hash(key, p->disp[lang_hash(key, 0) % p->nbuckets]) % (uint32_t)n;
+        p->words[s] = dup_string(key);
     }
+    free(first);
+    free(next);
+    free(taken);
+    free(slots);
+    free(order);
 }
 
-// Entferne Newline am ende einer Zeile
-static void trim_newline(char *s) {
-    if (s == NULL) return;
-    size_t l = strlen(s);
-    if (l == 0) return;
-    if (s[l-1] == '\n') {
-        s[l-1] = '\0';
-        l--;
+// Paket aus Wort- und Satzliste kompilieren (einmal beim Start, Laufzeit linear in der Textmenge)
+static void lang_build(LangPack *p, const LangSource *src) {
+    Map vocab;
+    size_t i;
+
+    memset(p, 0, sizeof(*p));
+    p->name = src->name;
+    map_init(&vocab);
+    for (i = 0; i < src->nwords; i++) map_add(&vocab, src->words[i], 1);
+    for (i = 0; i < src->nsentences; i++) {
+        const char *s = src->sentences[i];
+        char *tok;
+        while ((tok = lang_next_token(&s)) != NULL) {
+            map_add(&vocab, tok, 1);
+            free(tok);
+        }
     }
-    if (l > 0 && s[l-1] == '\r') {
-        s[l-1] = '\0';
+    lang_build_hash(p, &vocab);
+    map_free(&vocab);
+
+    p->bank_n = src->nwords;
+    p->bank = malloc((p->bank_n + 1) * sizeof(int32_t));
+    p->sentence_n = src->nsentences;
+    p->sentences = calloc(p->sentence_n + 1, sizeof(LangSentence));
+    if (p->bank == NULL || p->sentences == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    for (i = 0; i < p->bank_n; i++) p->bank[i] = lang_word_id(p, src->words[i]);
+    for (i = 0; i < p->sentence_n; i++) {
+        LangSentence *ls = &p->sentences[i];
+        const char *s = src->sentences[i];
+        size_t cap = 0;
+        char *tok;
+        ls->text = src->sentences[i];
+        while ((tok = lang_next_token(&s)) != NULL) {
+            if (ls->n == cap) {
+                size_t new_cap = (cap == 0) ? 8 : cap * 2;
+                int32_t *tmp = realloc(ls->ids, new_cap * sizeof(int32_t));
+                if (tmp == NULL) {
+                    printf("Fehler bei realloc\n");
+                    exit(1);
+                }
+                ls->ids = tmp;
+                cap = new_cap;
+            }
+            ls->ids[ls->n++] = lang_word_id(p, tok);
+            free(tok);
+        }
     }
 }
 
-// Benötigte Zeit in Sekunden zwischen zwei timevals berechnen
-static double elapsed_seconds(struct timeval start, struct timeval end) {
-    double s = (double)(end.tv_sec - start.tv_sec);
-    double us = (double)(end.tv_usec - start.tv_usec) / 1000000.0;
-    return s + us;
+// Paket der Sprache name kompilieren (NULL = erste Sprache), 0 wenn unbekannt
+static int lang_init(const char *name) {
+    size_t l;
+    for (l = 0; l < LANG_COUNT; l++) {
+        if (name == NULL || strcmp(lang_sources[l].name, name) == 0) {
+            lang_build(&lang, &lang_sources[l]);
+            return 1;
+        }
+    }
+    return 0;
 }
 
-// Struct für vergleichsergebnisse
+// ---------- Betriebsmetriken ----------
+// Zähler, Messwerte und Latenz-Histogramme für den Betrieb unter Last. Updates sind einzelne atomare
+// Additionen ohne Sperre. Mit --metrics FILE wird alles im Prometheus-Textformat in FILE geschrieben
+// (höchstens alle METRICS_INTERVAL Sekunden bei Aktivität, am Session-Ende und beim Beenden).
+// Histogramme sind HDR-artig: 16 Unterteilungen pro Zweierpotenz von Nanosekunden (Fehler < 7 %).
+
+#define METRICS_INTERVAL 10
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (2 * HIST_SUB + (64 - HIST_SUB_BITS - 1) * HIST_SUB)
+
+enum {
+    MC_SESSIONS,            // abgeschlossene Sessions
+    MC_ITEMS,               // ausgewertete Items (compare_and_update)
+    MC_KEYS,                // Anschläge in der Live-Auswertung
+    MC_SAVES,               // geschriebene Fehler-Maps
+    MC_COUNT
+};
+
+static const char *const metric_counter_names[MC_COUNT][2] = {
+    { "tt_sessions_total", "Practice sessions completed." },
+    { "tt_items_scored_total", "Items scored by compare_and_update." },
+    { "tt_keystrokes_total", "Keystrokes processed by the live scorer." },
+    { "tt_map_saves_total", "Mistake maps written to disk." },
+};
+
 typedef struct {
-    size_t correct_chars;
-    size_t total_chars;
-    size_t correct_words;
-    size_t total_words;
-} CompareResult;
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t n;
+    uint64_t sum_ns;
+} LatencyHist;
 
-// Wörter aus Text in ein Wörter-Array sammeln, Anzahl zurückgeben
-static int collect_words(const char *text, char words[][256], int max_words) {
-    int count = 0;
-    const char *p = text;
-    while (*p && count < max_words) {
-        while (*p && isspace((unsigned char)*p)) p++;
-        if (!*p) break;
-        char *w = words[count];
-        while (*p && !isspace((unsigned char)*p) && w < words[count] + 255) {
-            *w++ = *p++;
-        }
-        *w = '\0';
-        count++;
+enum { MH_SCORING, MH_PERSIST, MH_COUNT };
+
+static const char *const metric_hist_names[MH_COUNT][2] = {
+    { "tt_scoring_seconds", "Latency of scoring one item." },
+    { "tt_persist_seconds", "Latency of persisting a session (stats, maps)." },
+};
+
+static uint64_t metric_counters[MC_COUNT];
+static LatencyHist metric_hists[MH_COUNT];
+static const char *metrics_path = NULL;     // NULL = keine Metriken schreiben
+
+static void metric_inc(int c) {
+    __atomic_fetch_add(&metric_counters[c], 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t metric_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Bucket zu einem Wert: unter 2 * HIST_SUB exakt, darüber HIST_SUB Stufen pro Zweierpotenz
+static size_t hist_bucket(uint64_t v) {
+    int e;
+    if (v < 2 * HIST_SUB) return (size_t)v;
+    e = 63 - __builtin_clzll(v);
+    return (size_t)(2 * HIST_SUB + (e - HIST_SUB_BITS - 1) * HIST_SUB + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1)));
+}
+
+// obere Grenze eines Buckets (für die Quantile)
+static uint64_t hist_upper(size_t b) {
+    size_t e, sub;
+    if (b < 2 * HIST_SUB) return b;
+    e = (b - 2 * HIST_SUB) / HIST_SUB + HIST_SUB_BITS + 1;
+    sub = (b - 2 * HIST_SUB) % HIST_SUB;
+    return ((uint64_t)(HIST_SUB + sub + 1) << (e - HIST_SUB_BITS)) - 1;
+}
+
+static void metric_observe(int h, uint64_t ns) {
+    LatencyHist *x = &metric_hists[h];
+    __atomic_fetch_add(&x->counts[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&x->n, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&x->sum_ns, ns, __ATOMIC_RELAXED);
+}
+
+static double hist_quantile(const LatencyHist *x, double q) {
+    uint64_t n = __atomic_load_n(&x->n, __ATOMIC_RELAXED);
+    uint64_t rank = (uint64_t)(q * (double)n);
+    uint64_t acc = 0;
+    size_t b;
+    if (n == 0) return 0.0;
+    if (rank >= n) rank = n - 1;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        acc += __atomic_load_n(&x->counts[b], __ATOMIC_RELAXED);
+        if (acc > rank) return (double)hist_upper(b) / 1e9;
     }
-    return count;
+    return (double)hist_upper(HIST_BUCKETS - 1) / 1e9;
 }
 
-// Fehler von falschen Wortpaaren sammeln
-static void add_char_mistakes(const char *ref_word, const char *typed_word, Map *mchars) {
-        size_t i = 0;
-        size_t j = 0;
-        size_t rwlen = strlen(ref_word);
-        size_t twlen = strlen(typed_word);
-        while (i < rwlen && j < twlen) {
-            if (ref_word[i] == typed_word[j]) {
-                // Zeichen passt, weiter
-                i++;
-                j++;
-                continue;
+// ---------- Binärer Snapshot der Maps ----------
+// Neben jeder .txt Datei liegt ein Snapshot (z.B. mistakes_words.snap), der direkt per mmap verwendet wird:
+// kein Parsen, keine Allokation und kein Hashing pro Key. Aufbau (alles in Host-Byte-Reihenfolge):
+//   SnapHeader (sizeof(SnapHeader), 80 Bytes)
+//   KeyCount items[n]         wie im Speicher (LP64), key enthält den Offset im Key-Blob
+//   uint32_t index[index_cap] vorberechneter Hash-Index wie in Map (optional, index_cap = 0)
+//   char     blob[blob_len]   Keys mit '\0', auf 8 Bytes aufgefüllt
+// Beim Laden zeigt Map.items direkt ins (private) Mapping, nur die Key-Offsets werden zu Zeigern.
+// Geprüft werden immer Header und Index (head_checksum); die Prüfsumme über alle Nutzdaten nur mit --verify.
+// Die .txt Datei bleibt die massgebliche Quelle: Der Header merkt sich Grösse und mtime der .txt,
+// passt das nicht (z.B. von Hand oder mit einer alten Version geändert), wird die .txt geparst.
+
+#define SNAP_MAGIC "TTSNAP\r\n"
+#define SNAP_VERSION 2
+
+static int snap_verify = 0;     // --verify: ganze Snapshots beim Laden prüfen
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t n;
+    uint64_t index_cap;
+    uint64_t blob_len;
+    int64_t txt_size;
+    int64_t txt_mtime_sec;
+    int64_t txt_mtime_nsec;
+    uint64_t checksum;   // über alles nach dem Header
+    uint64_t head_checksum; // über den Header (ohne die Prüfsummen) und den Index
+} SnapHeader;
+
+// Schnelle 64-Bit Prüfsumme, verarbeitet 8 Bytes pro Schritt (len muss ein Vielfaches von 8 sein)
+static uint64_t snap_checksum(const unsigned char *p, size_t len) {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ len;
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Prüfsumme über Header und Index, die beim Laden ohne --verify genügt
+static uint64_t snap_head_checksum(const SnapHeader *h, const uint32_t *index) {
+    SnapHeader copy = *h;
+    copy.checksum = 0;
+    copy.head_checksum = 0;
+    return snap_checksum((const unsigned char*)&copy, sizeof(copy)) ^
+           snap_checksum((const unsigned char*)index, (size_t)h->index_cap * 4);
+}
+
+// Das Satzformat ist KeyCount auf LP64 (Zeiger und long je 8 Bytes); sonst gibt es keine Snapshots
+static int snap_supported(void) {
+    return sizeof(KeyCount) == 24 && sizeof(char*) == 8 && sizeof(long) == 8;
+}
+
+// Pfad des Snapshots zur .txt Datei ("x.txt" -> "x.snap")
+static void snap_path(const char *filename, char *out, size_t size) {
+    size_t len = strlen(filename);
+    if (len > 4 && strcmp(filename + len - 4, ".txt") == 0) len -= 4;
+    snprintf(out, size, "%.*s.snap", (int)len, filename);
+}
+
+// Snapshot schreiben (zuerst in eine temporäre Datei, dann atomar umbenennen)
+static void save_map_snapshot(const Map *m, const char *filename) {
+    char path[512];
+    char tmp_path[520];
+    struct stat st;
+    SnapHeader h;
+    size_t blob_len = 0;
+    size_t index_cap;
+    size_t payload_len;
+    unsigned char *payload;
+    uint64_t *recs;
+    uint32_t *index;
+    char *blob;
+    size_t i;
+    FILE *f;
+
+    if (!snap_supported() || stat(filename, &st) != 0) return;
+    for (i = 0; i < m->n; i++) blob_len += strlen(m->items[i].key) + 1;
+    blob_len = (blob_len + 7) & ~(size_t)7;
+    index_cap = 16;
+    while (m->n * 4 > index_cap * 3) index_cap *= 2;
+
+    payload_len = m->n * 24 + index_cap * 4 + blob_len;
+    payload = calloc(1, payload_len);
+    if (payload == NULL) {
+        printf("Fehler bei calloc\n");
+        return;
+    }
+    recs = (uint64_t*)payload;
+    index = (uint32_t*)(payload + m->n * 24);
+    blob = (char*)(payload + m->n * 24 + index_cap * 4);
+    {
+        size_t off = 0;
+        for (i = 0; i < m->n; i++) {
+            size_t len = strlen(m->items[i].key) + 1;
+            size_t s = key_hash(m->items[i].key) & (index_cap - 1);
+            memcpy(blob + off, m->items[i].key, len);
+            recs[i * 3] = off;
+            recs[i * 3 + 1] = (uint64_t)(int64_t)m->items[i].count;
+            recs[i * 3 + 2] = (uint64_t)(int64_t)m->items[i].err;
+            off += len;
+            while (index[s] != 0) s = (s + 1) & (index_cap - 1);
+            index[s] = (uint32_t)(i + 1);
+        }
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, 8);
+    h.version = SNAP_VERSION;
+    h.header_size = sizeof(SnapHeader);
+    h.n = m->n;
+    h.index_cap = index_cap;
+    h.blob_len = blob_len;
+    h.txt_size = (int64_t)st.st_size;
+    h.txt_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    h.txt_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    h.checksum = snap_checksum(payload, payload_len);
+    h.head_checksum = snap_head_checksum(&h, index);
+
+    snap_path(filename, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        free(payload);
+        return;
+    }
+    if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(payload, 1, payload_len, f) != payload_len) {
+        fclose(f);
+        remove(tmp_path);
+        free(payload);
+        return;
+    }
+    if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+    free(payload);
+}
+
+// Snapshot laden, falls er gültig ist und zur .txt passt. Rückgabe 1 = geladen, 0 = .txt parsen
+static int load_map_snapshot(Map *m, const char *filename) {
+    char path[512];
+    struct stat txt_st, st;
+    const SnapHeader *h;
+    unsigned char *base;
+    unsigned char *payload;
+    KeyCount *items;
+    char *blob;
+    size_t payload_len;
+    size_t i;
+    int fd;
+
+    if (!snap_supported()) return 0;
+    if (m->n != 0 || m->snap != NULL) return 0; // nur in eine leere Map
+    if (stat(filename, &txt_st) != 0) return 0;
+    snap_path(filename, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader)) {
+        close(fd);
+        return 0;
+    }
+    // MAP_PRIVATE: Schreibzugriffe (Key-Zeiger, Zähler, Index) landen nie in der Datei
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+
+    h = (const SnapHeader*)base;
+    payload = base + sizeof(SnapHeader);
+    payload_len = (size_t)st.st_size - sizeof(SnapHeader);
+    if (memcmp(h->magic, SNAP_MAGIC, 8) != 0 || h->version != SNAP_VERSION || h->header_size != sizeof(SnapHeader)
+        || h->txt_size != (int64_t)txt_st.st_size || h->txt_mtime_sec != (int64_t)txt_st.st_mtim.tv_sec
+        || h->txt_mtime_nsec != (int64_t)txt_st.st_mtim.tv_nsec
+        || h->n > UINT32_MAX || h->index_cap > ((uint64_t)1 << 32) || (h->index_cap & (h->index_cap - 1)) != 0
+        || h->n * 24 + h->index_cap * 4 + h->blob_len != payload_len
+        || (h->index_cap != 0 && h->n * 4 > h->index_cap * 3)
+        || h->blob_len == 0 || payload[payload_len - 1] != '\0'
+        || snap_head_checksum(h, (const uint32_t*)(payload + h->n * 24)) != h->head_checksum
+        || (snap_verify && snap_checksum(payload, payload_len) != h->checksum)) {
+        munmap(base, (size_t)st.st_size);
+        return 0;
+    }
+
+    // Key-Offsets in Zeiger ins Mapping umwandeln (Keys sind im Blob terminiert, siehe oben)
+    items = (KeyCount*)payload;
+    blob = (char*)(payload + h->n * 24 + h->index_cap * 4);
+    for (i = 0; i < h->n; i++) {
+        uint64_t off;
+        memcpy(&off, &items[i].key, sizeof(off));
+        if (off >= h->blob_len) {
+            munmap(base, (size_t)st.st_size);
+            return 0;
+        }
+        items[i].key = blob + off;
+    }
+    m->items = items;
+    m->items_owned = 0;
+    m->n = (size_t)h->n;
+    m->cap = m->n;
+    m->snap = base;
+    m->snap_len = (size_t)st.st_size;
+    if (h->index_cap > 0) {
+        // vorberechneten Index direkt aus dem Mapping verwenden
+        m->index = (uint32_t*)(payload + h->n * 24);
+        m->index_cap = (size_t)h->index_cap;
+        m->index_owned = 0;
+    } else if (m->n > 0) {
+        size_t cap = 16;
+        while (m->n * 4 > cap * 3) cap *= 2;
+        map_index_rebuild(m, cap);
+    }
+    return 1;
+}
+
+// Pfad der Uhr-Datei zur .txt Datei ("x.txt" -> "x.decay")
+static void decay_path(const char *filename, char *out, size_t size) {
+    size_t len = strlen(filename);
+    if (len > 4 && strcmp(filename + len - 4, ".txt") == 0) len -= 4;
+    snprintf(out, size, "%.*s%s", (int)len, filename, DECAY_EXT);
+}
+
+// Uhr des Verfalls lesen ("HALF_LIFE LANDMARK", keine Datei = kein Verfall)
+static void map_read_clock(const char *filename, double *half_life, time_t *landmark) {
+    char path[512];
+    long long t;
+    FILE *f;
+    *half_life = 0.0;
+    *landmark = 0;
+    decay_path(filename, path, sizeof(path));
+    f = fopen(path, "r");
+    if (f == NULL) return;
+    if (fscanf(f, "%lf %lld", half_life, &t) == 2 && *half_life > 0.0) {
+        *landmark = (time_t)t;
+    } else {
+        *half_life = 0.0;
+    }
+    fclose(f);
+}
+
+// Uhr neben die .txt schreiben bzw. ohne Verfall entfernen
+static void map_write_clock(const Map *m, const char *filename) {
+    char path[512];
+    FILE *f;
+    decay_path(filename, path, sizeof(path));
+    if (m->half_life <= 0.0) {
+        remove(path);
+        return;
+    }
+    f = fopen(path, "w");
+    if (f == NULL) {
+        perror("fopen decay");
+        return;
+    }
+    fprintf(f, "%.0f %lld\n", m->half_life, (long long)m->landmark);
+    fclose(f);
+}
+
+// Lade Map-Daten aus Datei (Format: "key\tcount\n"), wenn möglich aus dem passenden Snapshot.
+// Die Uhr des Verfalls wird mit übernommen (danach mit map_set_decay auf die gewünschte Halbwertszeit bringen).
+static void load_map_from_file(Map *m, const char *filename) {
+    double half_life;
+    time_t landmark;
+    map_read_clock(filename, &half_life, &landmark);
+    // begrenzte Maps (map_set_limit vor dem Laden) lesen die Textdatei über Space-Saving ein,
+    // der Snapshot hat keine Fehlerschranken
+    if (m->limit == 0 && load_map_snapshot(m, filename)) {
+        m->half_life = half_life;
+        m->landmark = landmark;
+        return;
+    }
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        return; // File existiert nicht
+    }
+    // getline vergrössert den Puffer selbst, Zeilen dürfen beliebig lang sein
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, f) >= 0) {
+        char *tab = strchr(line, '\t');
+        if (tab == NULL) continue;
+        *tab = '\0';
+        char *key = line;
+        char *num = tab + 1;
+        char *end;
+        long cnt, err;
+        if (half_life > 0.0) {
+            // aktuelle Werte mit Nachkommastellen, intern in Einheiten von 1 / DECAY_UNIT
+            cnt = (long)(strtod(num, &end) * DECAY_UNIT + 0.5);
+            err = (*end == '\t') ? (long)(strtod(end + 1, NULL) * DECAY_UNIT + 0.5) : 0;
+        } else {
+            cnt = strtol(num, &end, 10);
+            err = (*end == '\t') ? atol(end + 1) : 0; // optionale dritte Spalte: Fehlerschranke
+        }
+        if (cnt != 0) {
+            map_add(m, key, cnt);
+            if (err > 0) {
+                long found = map_find(m, key);
+                if (found >= 0) m->items[found].err += err;
             }
-            //Fall 1: In typed_word ist ein Zeichen zu viel (Insertion), Beispiel: ref = "Haus", typed = "Haaus"
-            if (j + 1 < twlen && ref_word[i] == typed_word[j + 1]) {
-                // aktuelles typed-Zeichen ist "zu viel"
-                map_add_char(mchars, typed_word[j], 1);
-                j++; // typed aufholen
-                continue;
+        }
+    }
+    free(line);
+    m->half_life = half_life;
+    if (half_life > 0.0) {
+        // die Werte gelten zum Zeitpunkt des Schreibens (auch wenn main.c die Datei geschrieben hat)
+        struct stat st;
+        m->landmark = (fstat(fileno(f), &st) == 0) ? st.st_mtime : time(NULL);
+    }
+    fclose(f);
+}
+
+// Speichere Map-Daten in Datei (Format: "key\tcount\n", mit Verfall die aktuellen Werte, Uhr daneben)
+static void save_map_to_file(Map *m, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    double w = map_weight(m);
+    size_t i;
+    if (f == NULL) {
+        perror("fopen");
+        return;
+    }
+    metric_inc(MC_SAVES);
+    // nach Schlüssel sortiert schreiben, damit Dateien per k-Wege-Merge kombiniert werden können
+    KeyCount **order = malloc((m->n + 1) * sizeof(KeyCount *));
+    if (order == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    for (i = 0; i < m->n; i++) order[i] = &m->items[i];
+    qsort(order, m->n, sizeof(KeyCount *), cmp_kc_key);
+    for (i = 0; i < m->n; i++) {
+        if (m->half_life > 0.0) {
+            double v = (double)order[i]->count / w;
+            if (v < 0.0005) continue;   // ganz verfallen
+            if (order[i]->err > 0) fprintf(f, "%s\t%.3f\t%.3f\n", order[i]->key, v, (double)order[i]->err / w);
+            else fprintf(f, "%s\t%.3f\n", order[i]->key, v);
+        } else if (order[i]->err > 0) {
+            fprintf(f, "%s\t%ld\t%ld\n", order[i]->key, order[i]->count, order[i]->err);
+        } else {
+            fprintf(f, "%s\t%ld\n", order[i]->key, order[i]->count);
+        }
+    }
+    free(order);
+    fclose(f);
+    map_write_clock(m, filename);
+    if (m->limit == 0) save_map_snapshot(m, filename);
+}
+
+// ---------- Fehlerdateien mehrerer Rechner zusammenführen ----------
+// --merge-mistakes OUT IN...: k-Wege-Merge über nach Schlüssel sortierte Dateien, gleiche
+// Schlüssel werden summiert. Sortierte Eingaben werden direkt gestreamt, unsortierte (ältere
+// Dateien) zuerst in sortierte Läufe von höchstens MERGE_RUN_BYTES zerlegt. Es sind nie mehr
+// als MERGE_FANIN Läufe offen, der Speicherbedarf hängt also nicht von der Eingabegrösse ab.
+#define MERGE_RUN_BYTES (8u << 20)
+#define MERGE_FANIN 64
+
+typedef struct {
+    FILE *f;
+    char *line;
+    size_t cap;
+    char *key;              // zeigt in line
+    long count;
+} MergeCursor;
+
+typedef struct {
+    FILE *runs[MERGE_FANIN];
+    size_t n;
+} MergeRuns;
+
+// Nächste gültige Zeile "key\tcount" lesen, 0 am Dateiende
+static int cursor_next(MergeCursor *c) {
+    while (getline(&c->line, &c->cap, c->f) >= 0) {
+        char *tab = strchr(c->line, '\t');
+        if (tab == NULL) continue;
+        *tab = '\0';
+        c->key = c->line;
+        c->count = (long)(strtod(tab + 1, NULL) + 0.5);   // mit --decay gespeicherte Werte haben Nachkommastellen
+        return 1;
+    }
+    return 0;
+}
+
+static void merge_sift_down(MergeCursor **heap, size_t n, size_t i) {
+    while (1) {
+        size_t l = 2 * i + 1;
+        size_t best = i;
+        MergeCursor *tmp;
+        if (l < n && strcmp(heap[l]->key, heap[best]->key) < 0) best = l;
+        if (l + 1 < n && strcmp(heap[l + 1]->key, heap[best]->key) < 0) best = l + 1;
+        if (best == i) return;
+        tmp = heap[i];
+        heap[i] = heap[best];
+        heap[best] = tmp;
+        i = best;
+    }
+}
+
+// k sortierte Läufe zusammenführen, gleiche Schlüssel summieren, Ergebnis nach out
+static int merge_runs(FILE **runs, size_t k, FILE *out) {
+    MergeCursor *cur = calloc(k, sizeof(MergeCursor));
+    MergeCursor **heap = malloc(k * sizeof(MergeCursor *));
+    char *last = NULL;
+    size_t last_cap = 0;
+    long sum = 0;
+    size_t n = 0;
+    size_t i;
+
+    if (cur == NULL || heap == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    for (i = 0; i < k; i++) {
+        cur[i].f = runs[i];
+        if (cursor_next(&cur[i])) heap[n++] = &cur[i];
+    }
+    for (i = n / 2; i-- > 0;) merge_sift_down(heap, n, i);
+
+    while (n > 0) {
+        MergeCursor *top = heap[0];
+        if (last != NULL && strcmp(last, top->key) == 0) {
+            sum += top->count;
+        } else {
+            size_t len = strlen(top->key) + 1;
+            if (last != NULL && sum != 0) fprintf(out, "%s\t%ld\n", last, sum);
+            if (len > last_cap) {
+                char *tmp = realloc(last, len);
+                if (tmp == NULL) {
+                    printf("Fehler bei realloc\n");
+                    exit(1);
+                }
+                last = tmp;
+                last_cap = len;
             }
-            // Fall 2: In typed_word FEHLT ein Zeichen (Deletion), Beispiel: ref = "Haus", typed = "Hus"
-            if (i + 1 < rwlen && ref_word[i + 1] == typed_word[j]) {
-                // ref_word[i] wurde ausgelassen
-                map_add_char(mchars, ref_word[i], 1);
-                i++; // ref aufholen
-                continue;
+            memcpy(last, top->key, len);
+            sum = top->count;
+        }
+        if (!cursor_next(top)) heap[0] = heap[--n];
+        if (n > 0) merge_sift_down(heap, n, 0);
+    }
+    if (last != NULL && sum != 0) fprintf(out, "%s\t%ld\n", last, sum);
+
+    for (i = 0; i < k; i++) free(cur[i].line);
+    free(cur);
+    free(heap);
+    free(last);
+    return ferror(out) == 0;
+}
+
+// Lauf hinzufügen; sind schon MERGE_FANIN offen, werden sie vorher zu einem zusammengefasst
+static int merge_runs_push(MergeRuns *rs, FILE *f) {
+    if (rs->n == MERGE_FANIN) {
+        FILE *m = tmpfile();
+        size_t i;
+        int ok;
+        if (m == NULL) return 0;
+        for (i = 0; i < rs->n; i++) rewind(rs->runs[i]);
+        ok = merge_runs(rs->runs, rs->n, m);
+        for (i = 0; i < rs->n; i++) fclose(rs->runs[i]);
+        rs->runs[0] = m;
+        rs->n = 1;
+        if (!ok) return 0;
+    }
+    rs->runs[rs->n++] = f;
+    return 1;
+}
+
+// Gesammelte Einträge sortiert in einen temporären Lauf schreiben
+static int merge_flush_chunk(MergeRuns *rs, KeyCount **chunk, size_t n) {
+    FILE *f;
+    size_t i;
+    if (n == 0) return 1;
+    f = tmpfile();
+    if (f == NULL) return 0;
+    qsort(chunk, n, sizeof(KeyCount *), cmp_kc_key);
+    for (i = 0; i < n; i++) {
+        fprintf(f, "%s\t%ld\n", chunk[i]->key, chunk[i]->count);
+        free(chunk[i]->key);
+        free(chunk[i]);
+    }
+    if (ferror(f)) {
+        fclose(f);
+        return 0;
+    }
+    return merge_runs_push(rs, f);
+}
+
+// Prüft in einem Durchgang, ob die Datei schon nach Schlüssel sortiert ist
+static int file_is_sorted(FILE *f) {
+    MergeCursor c = {f, NULL, 0, NULL, 0};
+    char *prev = NULL;
+    size_t prev_cap = 0;
+    int sorted = 1;
+    while (sorted && cursor_next(&c)) {
+        size_t len = strlen(c.key) + 1;
+        if (prev != NULL && strcmp(prev, c.key) > 0) sorted = 0;
+        if (len > prev_cap) {
+            char *tmp = realloc(prev, len);
+            if (tmp == NULL) {
+                printf("Fehler bei realloc\n");
+                exit(1);
             }
-            // Fall 3: Substitution beides unterscheidet sich, aber kein klarer Insert/Delete
-            map_add_char(mchars, typed_word[j], 1);
-            i++;
-            j++;
+            prev = tmp;
+            prev_cap = len;
         }
-        // Restliche Zeichen in typed_word sind zu viel
-        while (j < twlen) {
-            map_add_char(mchars, typed_word[j], 1);
-            j++;
+        memcpy(prev, c.key, len);
+    }
+    free(c.line);
+    free(prev);
+    rewind(f);
+    return sorted;
+}
+
+// Eine Eingabedatei als Lauf (sortiert) oder als mehrere sortierte Läufe übernehmen
+static int merge_add_input(MergeRuns *rs, FILE *f) {
+    MergeCursor c = {f, NULL, 0, NULL, 0};
+    KeyCount **chunk = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+    size_t bytes = 0;
+    int ok = 1;
+
+    if (file_is_sorted(f)) return merge_runs_push(rs, f);
+
+    while (ok && cursor_next(&c)) {
+        KeyCount *kc;
+        if (n == cap) {
+            size_t new_cap = (cap == 0) ? 1024 : cap * 2;
+            KeyCount **tmp = realloc(chunk, new_cap * sizeof(KeyCount *));
+            if (tmp == NULL) {
+                printf("Fehler bei realloc\n");
+                exit(1);
+            }
+            chunk = tmp;
+            cap = new_cap;
+        }
+        kc = malloc(sizeof(KeyCount));
+        if (kc == NULL) {
+            printf("Fehler bei malloc\n");
+            exit(1);
+        }
+        kc->key = dup_string(c.key);
+        kc->count = c.count;
+        kc->err = 0;
+        chunk[n++] = kc;
+        bytes += strlen(c.key) + 1 + sizeof(KeyCount) + sizeof(KeyCount *);
+        if (bytes >= MERGE_RUN_BYTES) {
+            ok = merge_flush_chunk(rs, chunk, n);
+            n = 0;
+            bytes = 0;
+        }
+    }
+    if (ok) ok = merge_flush_chunk(rs, chunk, n);
+    free(chunk);
+    free(c.line);
+    fclose(f);
+    return ok;
+}
+
+static int merge_mistake_files(const char *out, char **inputs, int count) {
+    MergeRuns rs;
+    char tmp_path[1024];
+    FILE *f;
+    size_t i;
+    int ok = 1;
+    int k;
+
+    rs.n = 0;
+    for (k = 0; k < count && ok; k++) {
+        FILE *in = fopen(inputs[k], "r");
+        if (in == NULL) {
+            printf("Cannot read %s\n", inputs[k]);
+            ok = 0;
+            break;
         }
+        ok = merge_add_input(&rs, in);
+    }
+    // in eine temporäre Datei schreiben, damit OUT auch selbst Eingabe sein darf
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", out);
+    f = ok ? fopen(tmp_path, "w") : NULL;
+    if (f != NULL) {
+        for (i = 0; i < rs.n; i++) rewind(rs.runs[i]);
+        ok = merge_runs(rs.runs, rs.n, f);
+        if (fclose(f) != 0) ok = 0;
+        if (ok && rename(tmp_path, out) != 0) ok = 0;
+        if (!ok) remove(tmp_path);
+    } else {
+        ok = 0;
+    }
+    for (i = 0; i < rs.n; i++) fclose(rs.runs[i]);
+    if (!ok) {
+        perror("merge");
+        return 1;
+    }
+    printf("Merged %d mistake files into %s.\n", count, out);
+    return 0;
+}
+
+// ---------- Quantil-Sketches (KLL) für WPM und Genauigkeit ----------
+// Statt alle Sessions zu speichern und zu sortieren, hält ein KLL-Sketch pro Kennzahl nur einige hundert
+// Werte in "Kompaktoren" (Level h, jeder Wert zählt 2^h mal). Läuft ein Level über, wird es sortiert und
+// jeder zweite Wert wandert ein Level höher. Zwei Sketches lassen sich durch Aneinanderhängen der Levels
+// und erneutes Kompaktieren zusammenführen (z.B. von verschiedenen Rechnern oder Benutzern).
+// Datei: ein Sketch pro Zeile "name n min max levels len0 werte... len1 werte... rng R"
+// Der Zustand des Zufallsgenerators wird mitgespeichert: mit festem Startwert würde jede Sitzung
+// (laden, eine Session eintragen, einmal kompaktieren) dieselbe Hälfte behalten und die Quantile verschieben.
+
+#define SKETCH_FILE "stats_sketch.txt"
+#define KLL_K 200                // Genauigkeit: ca. 1.7/K Rangfehler
+#define KLL_MAX_LEVELS 40
+
+typedef struct {
+    char name[32];               // z.B. "wpm.all", "acc.words"
+    unsigned long long n;        // Anzahl eingefügter Werte
+    double min;
+    double max;
+    int levels;
+    double *lv[KLL_MAX_LEVELS];
+    size_t len[KLL_MAX_LEVELS];
+    size_t cap[KLL_MAX_LEVELS];
+    uint32_t rng;                // xorshift Zustand für die Kompaktierung
+} Kll;
+
+typedef struct {
+    Kll *items;
+    size_t n;
+} SketchSet;
+
+// Startwert für neue Sketches: pro Prozess und Sketch verschieden (nie 0, sonst bleibt xorshift bei 0)
+static uint32_t kll_seed(void) {
+    static uint32_t counter = 0;
+    uint64_t z = ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid() ^ ((uint64_t)++counter << 40);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return ((uint32_t)z != 0) ? (uint32_t)z : 2463534242u;
+}
+
+static void kll_init(Kll *s, const char *name) {
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->levels = 1;
+    s->rng = kll_seed();
+}
+
+static void kll_free(Kll *s) {
+    int h;
+    for (h = 0; h < KLL_MAX_LEVELS; h++) free(s->lv[h]);
+    memset(s, 0, sizeof(*s));
+}
+
+// Kapazität von Level h: K * (2/3)^(Tiefe unter dem obersten Level), mindestens 2
+static size_t kll_level_cap(const Kll *s, int h) {
+    size_t c = KLL_K;
+    int d;
+    for (d = s->levels - 1 - h; d > 0 && c > 2; d--) c = c * 2 / 3;
+    return (c < 2) ? 2 : c;
+}
+
+static void kll_push(Kll *s, int h, double v) {
+    if (s->len[h] == s->cap[h]) {
+        size_t newcap = (s->cap[h] == 0) ? 16 : s->cap[h] * 2;
+        double *tmp = realloc(s->lv[h], newcap * sizeof(double));
+        if (tmp == NULL) {
+            printf("Fehler bei realloc\n");
+            exit(1);
+        }
+        s->lv[h] = tmp;
+        s->cap[h] = newcap;
+    }
+    s->lv[h][s->len[h]++] = v;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Überlaufende Levels kompaktieren, bis der Sketch wieder in seine Gesamtkapazität passt
+static void kll_compress(Kll *s) {
+    while (1) {
+        size_t total = 0;
+        size_t total_cap = 0;
+        int h;
+        for (h = 0; h < s->levels; h++) {
+            total += s->len[h];
+            total_cap += kll_level_cap(s, h);
+        }
+        if (total <= total_cap) return;
+        for (h = 0; h < s->levels; h++) {
+            size_t i, keep, start, m;
+            if (s->len[h] < kll_level_cap(s, h)) continue;
+            if (h + 1 == s->levels) {
+                if (s->levels == KLL_MAX_LEVELS) return;
+                s->levels++;
+            }
+            qsort(s->lv[h], s->len[h], sizeof(double), cmp_double);
+            // bei ungerader Anzahl bleibt der grösste Wert auf diesem Level
+            keep = s->len[h] & 1;
+            s->rng ^= s->rng << 13;
+            s->rng ^= s->rng >> 17;
+            s->rng ^= s->rng << 5;
+            start = s->rng & 1;
+            m = s->len[h] - keep;
+            for (i = start; i < m; i += 2) {
+                kll_push(s, h + 1, s->lv[h][i]);
+            }
+            if (keep) s->lv[h][0] = s->lv[h][s->len[h] - 1];
+            s->len[h] = keep;
+            break;
+        }
+    }
+}
+
+static void kll_add(Kll *s, double v) {
+    if (s->n == 0 || v < s->min) s->min = v;
+    if (s->n == 0 || v > s->max) s->max = v;
+    s->n++;
+    kll_push(s, 0, v);
+    if (s->len[0] >= kll_level_cap(s, 0)) kll_compress(s);
+}
+
+// src in dst einmischen
+static void kll_merge(Kll *dst, const Kll *src) {
+    int h;
+    size_t i;
+    if (src->n == 0) return;
+    if (dst->n == 0 || src->min < dst->min) dst->min = src->min;
+    if (dst->n == 0 || src->max > dst->max) dst->max = src->max;
+    dst->n += src->n;
+    if (src->levels > dst->levels) dst->levels = src->levels;
+    for (h = 0; h < src->levels; h++) {
+        for (i = 0; i < src->len[h]; i++) kll_push(dst, h, src->lv[h][i]);
+    }
+    kll_compress(dst);
+}
+
+typedef struct {
+    double v;
+    unsigned long long w;
+} WeightedValue;
+
+static int cmp_weighted(const void *a, const void *b) {
+    return cmp_double(&((const WeightedValue*)a)->v, &((const WeightedValue*)b)->v);
+}
+
+// Wert beim Quantil q (0..1) schätzen
+static double kll_quantile(const Kll *s, double q) {
+    WeightedValue *all;
+    size_t count = 0;
+    size_t i;
+    unsigned long long total = 0;
+    unsigned long long target;
+    unsigned long long acc = 0;
+    double result;
+    int h;
+
+    if (s->n == 0) return 0.0;
+    if (q <= 0.0) return s->min;
+    if (q >= 1.0) return s->max;
+    for (h = 0; h < s->levels; h++) count += s->len[h];
+    all = malloc(count * sizeof(WeightedValue));
+    if (all == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    count = 0;
+    for (h = 0; h < s->levels; h++) {
+        for (i = 0; i < s->len[h]; i++) {
+            all[count].v = s->lv[h][i];
+            all[count].w = 1ull << h;
+            total += all[count].w;
+            count++;
+        }
+    }
+    qsort(all, count, sizeof(WeightedValue), cmp_weighted);
+    target = (unsigned long long)(q * (double)total);
+    result = all[count - 1].v;
+    for (i = 0; i < count; i++) {
+        acc += all[i].w;
+        if (acc > target) {
+            result = all[i].v;
+            break;
+        }
+    }
+    free(all);
+    return result;
+}
+
+static void sketches_free(SketchSet *set) {
+    size_t i;
+    for (i = 0; i < set->n; i++) kll_free(&set->items[i]);
+    free(set->items);
+    set->items = NULL;
+    set->n = 0;
+}
+
+// Sketch mit diesem Namen holen, bei Bedarf anlegen
+static Kll *sketch_get(SketchSet *set, const char *name) {
+    size_t i;
+    Kll *tmp;
+    for (i = 0; i < set->n; i++) {
+        if (strcmp(set->items[i].name, name) == 0) return &set->items[i];
+    }
+    tmp = realloc(set->items, (set->n + 1) * sizeof(Kll));
+    if (tmp == NULL) {
+        printf("Fehler bei realloc\n");
+        exit(1);
+    }
+    set->items = tmp;
+    kll_init(&set->items[set->n], name);
+    return &set->items[set->n++];
+}
+
+// Sketches aus einer Datei laden (fehlende Datei = leere Menge). Rückgabe 0 wenn die Datei fehlt
+static int sketches_load(SketchSet *set, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    char *line = NULL;
+    size_t line_cap = 0;
+    if (f == NULL) return 0;
+    while (getline(&line, &line_cap, f) >= 0) {
+        char name[32];
+        unsigned long long n;
+        double mn, mx;
+        int levels, used, h;
+        unsigned int rng;
+        char *p = line;
+        Kll tmp;
+        Kll *s;
+        if (sscanf(p, "%31s %llu %lf %lf %d%n", name, &n, &mn, &mx, &levels, &used) != 5) continue;
+        if (levels < 1 || levels > KLL_MAX_LEVELS) continue;
+        p += used;
+        kll_init(&tmp, name);
+        tmp.levels = levels;
+        tmp.n = n;
+        tmp.min = mn;
+        tmp.max = mx;
+        for (h = 0; h < levels; h++) {
+            size_t len, i;
+            if (sscanf(p, "%zu%n", &len, &used) != 1) break;
+            p += used;
+            for (i = 0; i < len; i++) {
+                double v;
+                if (sscanf(p, "%lf%n", &v, &used) != 1) break;
+                p += used;
+                kll_push(&tmp, h, v);
+            }
+        }
+        // gleichnamige Sketches (z.B. zusammenkopierte Dateien) werden gemischt.
+        // Ältere Dateien ohne "rng" behalten den neuen Startwert
+        s = sketch_get(set, name);
+        if (h == levels && sscanf(p, " rng %u", &rng) == 1 && rng != 0) {
+            if (s->n == 0) s->rng = rng;
+            else s->rng ^= rng;
+            if (s->rng == 0) s->rng = kll_seed();
+        }
+        kll_merge(s, &tmp);
+        kll_free(&tmp);
+    }
+    free(line);
+    fclose(f);
+    return 1;
+}
+
+static void sketches_save(const SketchSet *set, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    size_t i, j;
+    int h;
+    if (f == NULL) {
+        perror("fopen sketch");
+        return;
+    }
+    for (i = 0; i < set->n; i++) {
+        const Kll *s = &set->items[i];
+        fprintf(f, "%s %llu %.4f %.4f %d", s->name, s->n, s->min, s->max, s->levels);
+        for (h = 0; h < s->levels; h++) {
+            fprintf(f, " %zu", s->len[h]);
+            for (j = 0; j < s->len[h]; j++) fprintf(f, " %.4f", s->lv[h][j]);
+        }
+        fprintf(f, " rng %u\n", (unsigned int)s->rng);
+    }
+    fclose(f);
+}
+
+// Eine Session in die Sketches "all" und den Modus eintragen
+static void sketches_record(SketchSet *set, const char *mode, double wpm, double accuracy) {
+    char name[32];
+    kll_add(sketch_get(set, "wpm.all"), wpm);
+    kll_add(sketch_get(set, "acc.all"), accuracy);
+    if (mode == NULL) return;
+    snprintf(name, sizeof(name), "wpm.%s", mode);
+    kll_add(sketch_get(set, name), wpm);
+    snprintf(name, sizeof(name), "acc.%s", mode);
+    kll_add(sketch_get(set, name), accuracy);
+}
+
+// Sketch-Dateien zusammenführen: --merge-sketches OUT IN...
+static int merge_sketch_files(const char *out, char **inputs, int count) {
+    SketchSet set = {NULL, 0};
+    int i;
+    for (i = 0; i < count; i++) {
+        if (!sketches_load(&set, inputs[i])) {
+            printf("Cannot read %s\n", inputs[i]);
+            sketches_free(&set);
+            return 1;
+        }
+    }
+    sketches_save(&set, out);
+    printf("Merged %d sketch files into %s (%zu sketches).\n", count, out, set.n);
+    sketches_free(&set);
+    return 0;
+}
+
+// ---------- Komprimiertes Archiv für alte Sessions ----------
+// --archive-stats verschiebt alte Zeilen aus stats.txt in stats_archive.bin. Das Archiv besteht aus Blöcken
+// von bis zu ARCHIVE_BLOCK_ROWS Sessions, spaltenweise bitgepackt:
+//   Zeitstempel als Differenz zur vorherigen Session (zigzag), WPM und Genauigkeit in Hundertsteln
+//   (gleiche Auflösung wie stats.txt, also verlustfrei), Zeichenanzahl.
+// Jede Spalte speichert nur (Wert - Blockminimum) mit so vielen Bits wie im Block nötig.
+// Der Blockheader enthält Min/Max-Zeit und Summen, Aggregationen lesen daher nur die Header und
+// überspringen die Nutzdaten; Zeitbereichsabfragen überspringen Blöcke ausserhalb des Bereichs.
+// Bewusst verlustfrei: das Archiv ist etwa 6x kleiner als stats.txt, nicht 10x. Sekundengenaue Zeiten
+// und WPM/Genauigkeit in Hundertsteln brauchen bei echten Sessions schon rund 45 Bits pro Zeile;
+// für 10x müsste die Genauigkeit gegenüber stats.txt sinken und die Summen würden abweichen.
+
+#define ARCHIVE_FILE "stats_archive.bin"
+#define ARCHIVE_MAGIC "TTARCH1\0"
+#define ARCHIVE_BLOCK_ROWS 4096
+#define ARCHIVE_COLS 4
+#define ARCHIVE_KEEP_DAYS 90     // Standard: Sessions älter als 90 Tage archivieren
+
+typedef struct {
+    uint32_t count;
+    uint32_t payload_len;
+    int64_t first_ts;       // Zeit der ersten Session im Block
+    int64_t min_ts;
+    int64_t max_ts;
+    int64_t sum_wpm;        // Hundertstel
+    int64_t sum_acc;        // Hundertstel
+    int64_t sum_chars;
+    int64_t best_wpm;       // Hundertstel
+    uint64_t base[ARCHIVE_COLS];
+    uint8_t bits[ARCHIVE_COLS];
+    uint8_t reserved[4];
+} ArchiveBlock;
+
+typedef struct {
+    int64_t ts;
+    int64_t wpm;            // Hundertstel
+    int64_t acc;            // Hundertstel
+    int64_t chars;
+} ArchiveRow;
+
+// Bitweises Schreiben/Lesen, niederwertige Bits zuerst
+typedef struct {
+    unsigned char *buf;
+    size_t pos;
+    uint32_t acc;
+    int n;                  // Anzahl Bits in acc
+} BitStream;
+
+// Callback für alle gespeicherten Sessions (Archiv und stats.txt)
+typedef void (*SessionRowFn)(void *ctx, time_t t, double wpm, double accuracy, long chars);
+
+// "YYYY-MM-DD" oder "YYYY-MM-DDTHH:MM:SS" (lokale Zeit) einlesen, -1 bei Fehler
+static time_t parse_iso_time(const char *s) {
+    struct tm tm_info;
+    memset(&tm_info, 0, sizeof(tm_info));
+    if (sscanf(s, "%d-%d-%dT%d:%d:%d", &tm_info.tm_year, &tm_info.tm_mon, &tm_info.tm_mday,
+               &tm_info.tm_hour, &tm_info.tm_min, &tm_info.tm_sec) < 3) {
+        return (time_t)-1;
+    }
+    tm_info.tm_year -= 1900;
+    tm_info.tm_mon -= 1;
+    tm_info.tm_isdst = -1;
+    return mktime(&tm_info);
+}
+
+// Wert mit 2 Nachkommastellen (wie in stats.txt) in Hundertstel umrechnen
+static int64_t to_centi(double v) {
+    return (v >= 0.0) ? (int64_t)(v * 100.0 + 0.5) : -(int64_t)(-v * 100.0 + 0.5);
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t bit_width(uint64_t v) {
+    uint8_t b = 0;
+    while (v) {
+        b++;
+        v >>= 1;
+    }
+    return b;
+}
+
+static void bits_put(BitStream *w, uint64_t v, int bits) {
+    while (bits > 0) {
+        int take = (bits < 8) ? bits : 8;
+        w->acc |= (uint32_t)(v & ((1u << take) - 1)) << w->n;
+        w->n += take;
+        v >>= take;
+        bits -= take;
+        while (w->n >= 8) {
+            w->buf[w->pos++] = (unsigned char)w->acc;
+            w->acc >>= 8;
+            w->n -= 8;
+        }
+    }
+}
+
+static uint64_t bits_get(BitStream *r, int bits) {
+    uint64_t v = 0;
+    int got = 0;
+    while (got < bits) {
+        int take;
+        if (r->n == 0) {
+            r->acc = r->buf[r->pos++];
+            r->n = 8;
+        }
+        take = (bits - got < r->n) ? bits - got : r->n;
+        v |= (uint64_t)(r->acc & ((1u << take) - 1)) << got;
+        r->acc >>= take;
+        r->n -= take;
+        got += take;
+    }
+    return v;
+}
+
+// Wert von Spalte c der Session i (Zeit als zigzag-Differenz zur vorherigen Session)
+static uint64_t archive_col(const ArchiveRow *rows, size_t i, int c) {
+    switch (c) {
+    case 0: return zigzag((i == 0) ? 0 : rows[i].ts - rows[i - 1].ts);
+    case 1: return (uint64_t)rows[i].wpm;
+    case 2: return (uint64_t)rows[i].acc;
+    default: return (uint64_t)rows[i].chars;
+    }
+}
+
+// Einen Block schreiben (rows in Dateireihenfolge)
+static int archive_write_block(FILE *f, const ArchiveRow *rows, size_t count) {
+    ArchiveBlock h;
+    BitStream w;
+    size_t total_bits = 0;
+    size_t i;
+    int c;
+    int ok;
+
+    memset(&h, 0, sizeof(h));
+    h.count = (uint32_t)count;
+    h.first_ts = rows[0].ts;
+    h.min_ts = rows[0].ts;
+    h.max_ts = rows[0].ts;
+    for (c = 0; c < ARCHIVE_COLS; c++) h.base[c] = UINT64_MAX;
+    for (i = 0; i < count; i++) {
+        for (c = 0; c < ARCHIVE_COLS; c++) {
+            uint64_t v = archive_col(rows, i, c);
+            if (v < h.base[c]) h.base[c] = v;
+        }
+        if (rows[i].ts < h.min_ts) h.min_ts = rows[i].ts;
+        if (rows[i].ts > h.max_ts) h.max_ts = rows[i].ts;
+        if (rows[i].wpm > h.best_wpm) h.best_wpm = rows[i].wpm;
+        h.sum_wpm += rows[i].wpm;
+        h.sum_acc += rows[i].acc;
+        h.sum_chars += rows[i].chars;
+    }
+    // Bitbreite pro Spalte: so viele Bits wie (Wert - Blockminimum) maximal braucht
+    for (i = 0; i < count; i++) {
+        for (c = 0; c < ARCHIVE_COLS; c++) {
+            uint8_t b = bit_width(archive_col(rows, i, c) - h.base[c]);
+            if (b > h.bits[c]) h.bits[c] = b;
+        }
+    }
+    for (c = 0; c < ARCHIVE_COLS; c++) total_bits += (size_t)h.bits[c] * count;
+    h.payload_len = (uint32_t)((total_bits + 7) / 8);
+
+    memset(&w, 0, sizeof(w));
+    w.buf = calloc(h.payload_len + 1, 1);
+    if (w.buf == NULL) {
+        printf("Fehler bei calloc\n");
+        exit(1);
+    }
+    // spaltenweise: erst alle Zeitdifferenzen, dann alle WPM usw.
+    for (c = 0; c < ARCHIVE_COLS; c++) {
+        for (i = 0; i < count; i++) bits_put(&w, archive_col(rows, i, c) - h.base[c], h.bits[c]);
+    }
+    if (w.n > 0) w.buf[w.pos++] = (unsigned char)w.acc;
+
+    ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(w.buf, 1, h.payload_len, f) == h.payload_len;
+    free(w.buf);
+    return ok;
+}
+
+// Nutzdaten eines Blocks entpacken (rows muss h->count Einträge fassen)
+static void archive_decode_block(const ArchiveBlock *h, unsigned char *payload, ArchiveRow *rows) {
+    BitStream r;
+    size_t i;
+    int c;
+    memset(&r, 0, sizeof(r));
+    r.buf = payload;
+    for (c = 0; c < ARCHIVE_COLS; c++) {
+        for (i = 0; i < h->count; i++) {
+            uint64_t v = bits_get(&r, h->bits[c]) + h->base[c];
+            if (c == 0) rows[i].ts = (i == 0) ? h->first_ts : rows[i - 1].ts + unzigzag(v);
+            else if (c == 1) rows[i].wpm = (int64_t)v;
+            else if (c == 2) rows[i].acc = (int64_t)v;
+            else rows[i].chars = (int64_t)v;
+        }
+    }
+}
+
+static FILE *archive_open(const char *mode) {
+    char magic[8];
+    FILE *f = fopen(ARCHIVE_FILE, mode);
+    if (f == NULL) return NULL;
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, ARCHIVE_MAGIC, 8) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// Alle archivierten Sessions im Bereich [since, until] an fn übergeben, andere Blöcke werden übersprungen
+static void archive_foreach(time_t since, time_t until, SessionRowFn fn, void *ctx) {
+    ArchiveBlock h;
+    FILE *f = archive_open("rb");
+    if (f == NULL) return;
+    while (fread(&h, sizeof(h), 1, f) == 1) {
+        unsigned char *payload;
+        ArchiveRow *rows;
+        size_t i;
+        if ((since != (time_t)-1 && h.max_ts < (int64_t)since) || (until != (time_t)-1 && h.min_ts > (int64_t)until)) {
+            if (fseek(f, (long)h.payload_len, SEEK_CUR) != 0) break;
+            continue;
+        }
+        payload = calloc(h.payload_len + 1, 1);
+        rows = malloc((h.count + 1) * sizeof(ArchiveRow));
+        if (payload == NULL || rows == NULL) {
+            printf("Fehler bei malloc\n");
+            exit(1);
+        }
+        if (fread(payload, 1, h.payload_len, f) != h.payload_len) {
+            free(payload);
+            free(rows);
+            break;
+        }
+        archive_decode_block(&h, payload, rows);
+        for (i = 0; i < h.count; i++) {
+            if (since != (time_t)-1 && rows[i].ts < (int64_t)since) continue;
+            if (until != (time_t)-1 && rows[i].ts > (int64_t)until) continue;
+            fn(ctx, (time_t)rows[i].ts, rows[i].wpm / 100.0, rows[i].acc / 100.0, (long)rows[i].chars);
+        }
+        free(payload);
+        free(rows);
+    }
+    fclose(f);
+}
+
+// Summen über das ganze Archiv, nur aus den Blockheadern
+static void archive_totals(size_t *sessions, double *sum_wpm, double *best_wpm, double *sum_acc) {
+    ArchiveBlock h;
+    FILE *f = archive_open("rb");
+    if (f == NULL) return;
+    while (fread(&h, sizeof(h), 1, f) == 1) {
+        *sessions += h.count;
+        *sum_wpm += h.sum_wpm / 100.0;
+        *sum_acc += h.sum_acc / 100.0;
+        if (h.best_wpm / 100.0 > *best_wpm) *best_wpm = h.best_wpm / 100.0;
+        if (fseek(f, (long)h.payload_len, SEEK_CUR) != 0) break;
+    }
+    fclose(f);
+}
+
+// Alle Sessions durchgehen: zuerst das Archiv, dann stats.txt
+static void stats_foreach(SessionRowFn fn, void *ctx) {
+    FILE *csv;
+    char date[64];
+    double wpm, acc;
+    long ch;
+    archive_foreach((time_t)-1, (time_t)-1, fn, ctx);
+    csv = fopen(STATS_FILE, "r");
+    if (csv == NULL) return;
+    while (fscanf(csv, "%63[^,],%lf,%lf,%ld\n", date, &wpm, &acc, &ch) == 4) {
+        fn(ctx, parse_iso_time(date), wpm, acc, ch);
+    }
+    fclose(csv);
+}
+
+// stats.txt öffnen und exklusiv sperren (Sperre bis fclose). archive_stats ersetzt die Datei per rename,
+// wer auf die Sperre gewartet hat, hält dann die alte Datei und öffnet neu
+static FILE *stats_open_locked(const char *mode) {
+    while (1) {
+        struct stat held, cur;
+        FILE *f = fopen(STATS_FILE, mode);
+        if (f == NULL) return NULL;
+        if (flock(fileno(f), LOCK_EX) != 0) return f;   // ohne Sperre (z.B. Netzlaufwerk) wie bisher
+        if (fstat(fileno(f), &held) == 0 && stat(STATS_FILE, &cur) == 0 &&
+            held.st_ino == cur.st_ino && held.st_dev == cur.st_dev) {
+            return f;
+        }
+        fclose(f);
+    }
+}
+
+// Datei auf die Platte bringen und schliessen, 0 bei Fehler
+static int fclose_synced(FILE *f) {
+    int ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = 0;
+    return ok;
+}
+
+// Sessions vor cutoff aus stats.txt ins Archiv verschieben: --archive-stats [--before DATE].
+// stats.txt bleibt während des ganzen Laufs gesperrt, damit keine neue Session verloren geht. Schlägt
+// etwas fehl, wird das Archiv auf die alte Länge gekürzt und stats.txt bleibt unverändert.
+static int archive_stats(time_t cutoff) {
+    FILE *csv;
+    FILE *rest;
+    FILE *arch;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ArchiveRow *rows;
+    size_t n = 0;
+    size_t archived = 0;
+    size_t kept = 0;
+    int ok = 1;
+    int created = 0;
+    off_t arch_start = 0;
+    struct stat st;
+    const char *tmp_path = STATS_FILE ".tmp";
+
+    csv = stats_open_locked("r");
+    if (csv == NULL) {
+        printf("No statistics recorded yet.\n");
+        return 1;
+    }
+    arch = archive_open("rb");
+    if (arch != NULL) {
+        // gültiges Archiv: neue Blöcke hinten anhängen
+        fclose(arch);
+        arch = fopen(ARCHIVE_FILE, "ab");
+        if (arch != NULL && (fseek(arch, 0, SEEK_END) != 0 || (arch_start = ftello(arch)) < 0)) ok = 0;
+    } else if (stat(ARCHIVE_FILE, &st) == 0 && st.st_size > 0) {
+        printf("%s is not a valid archive, leaving it untouched.\n", ARCHIVE_FILE);
+        fclose(csv);
+        return 1;
+    } else {
+        arch = fopen(ARCHIVE_FILE, "wb");
+        created = 1;
+        if (arch != NULL && fwrite(ARCHIVE_MAGIC, 1, 8, arch) != 8) ok = 0;
+    }
+    rest = fopen(tmp_path, "w");
+    rows = malloc(ARCHIVE_BLOCK_ROWS * sizeof(ArchiveRow));
+    if (rest == NULL || arch == NULL || rows == NULL) {
+        perror("archive");
+        if (rest != NULL) fclose(rest);
+        if (arch != NULL) fclose(arch);
+        if (created) remove(ARCHIVE_FILE);
+        fclose(csv);
+        free(rows);
+        remove(tmp_path);
+        return 1;
+    }
+
+    while (ok && getline(&line, &line_cap, csv) >= 0) {
+        char date[64];
+        double wpm, acc;
+        long ch;
+        time_t t;
+        if (sscanf(line, "%63[^,],%lf,%lf,%ld", date, &wpm, &acc, &ch) == 4
+            && (t = parse_iso_time(date)) != (time_t)-1 && t < cutoff) {
+            rows[n].ts = (int64_t)t;
+            rows[n].wpm = to_centi(wpm);
+            rows[n].acc = to_centi(acc);
+            rows[n].chars = ch;
+            n++;
+            archived++;
+            if (n == ARCHIVE_BLOCK_ROWS) {
+                ok = archive_write_block(arch, rows, n);
+                n = 0;
+            }
+        } else {
+            fputs(line, rest);
+            kept++;
+        }
+    }
+    if (ok && n > 0) ok = archive_write_block(arch, rows, n);
+    free(line);
+    free(rows);
+    if (!fclose_synced(arch)) ok = 0;
+    if (!fclose_synced(rest)) ok = 0;
+    // erst wenn das Archiv auf der Platte ist, stats.txt ersetzen; sonst die angehängten Blöcke verwerfen
+    if (!ok || rename(tmp_path, STATS_FILE) != 0) {
+        perror("archive");
+        remove(tmp_path);
+        if (created) remove(ARCHIVE_FILE);
+        else if (truncate(ARCHIVE_FILE, arch_start) != 0) perror("archive");
+        fclose(csv);
+        return 1;
+    }
+    fclose(csv);
+    if (stat(ARCHIVE_FILE, &st) != 0) st.st_size = 0;
+    printf("Archived %zu sessions, %zu remain in %s. Archive size: %lld bytes.\n",
+           archived, kept, STATS_FILE, (long long)st.st_size);
+    return 0;
+}
+
+// ---------- Zeitfenster: Tages-, Wochen- und Monats-Rollups ----------
+// Pro Granularität eine Binärdatei mit Datensätzen fester Grösse, sortiert nach Periodenbeginn.
+// append_session_stats aktualisiert den letzten Datensatz oder hängt einen neuen an. Abfragen
+// (--stats --since ... --group-by week) suchen den Startdatensatz binär und lesen nur den Bereich.
+
+#define ROLLUP_MAGIC "TTROLL1\0"
+#define ROLLUP_VERSION 1
+
+enum { ROLLUP_DAY = 0, ROLLUP_WEEK, ROLLUP_MONTH, ROLLUP_COUNT };
+
+static const char *rollup_files[ROLLUP_COUNT] = { "stats_day.bin", "stats_week.bin", "stats_month.bin" };
+static const char *rollup_names[ROLLUP_COUNT] = { "day", "week", "month" };
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} RollupHeader;
+
+typedef struct {
+    int64_t period_start;   // Epoch des Periodenbeginns (lokale Zeit)
+    uint32_t sessions;
+    uint32_t reserved;
+    double sum_wpm;
+    double best_wpm;
+    double sum_acc;
+    int64_t chars;
+} RollupRecord;
+
+// Beginn der Periode (Tag, Woche ab Montag, Monat), die den Zeitpunkt t enthält
+static time_t rollup_period(time_t t, int gran) {
+    struct tm tm_info = *localtime(&t);
+    tm_info.tm_hour = 0;
+    tm_info.tm_min = 0;
+    tm_info.tm_sec = 0;
+    tm_info.tm_isdst = -1;
+    if (gran == ROLLUP_WEEK) {
+        tm_info.tm_mday -= (tm_info.tm_wday + 6) % 7; // mktime normalisiert negative Tage
+    } else if (gran == ROLLUP_MONTH) {
+        tm_info.tm_mday = 1;
+    }
+    return mktime(&tm_info);
+}
+
+static void rollup_merge_record(RollupRecord *r, double wpm, double accuracy, long chars) {
+    r->sessions++;
+    r->sum_wpm += wpm;
+    r->sum_acc += accuracy;
+    if (wpm > r->best_wpm) r->best_wpm = wpm;
+    r->chars += chars;
+}
+
+// Rollup-Datei öffnen und Header prüfen. Rückgabe Anzahl Datensätze, -1 bei Fehler
+static long rollup_open(const char *filename, FILE **out, int create) {
+    RollupHeader h;
+    long size;
+    FILE *f = fopen(filename, "r+b");
+    if (f == NULL && create) {
+        f = fopen(filename, "w+b");
+        if (f == NULL) return -1;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, ROLLUP_MAGIC, 8);
+        h.version = ROLLUP_VERSION;
+        h.record_size = sizeof(RollupRecord);
+        if (fwrite(&h, sizeof(h), 1, f) != 1) {
+            fclose(f);
+            return -1;
+        }
+    }
+    if (f == NULL) return -1;
+    if (fseek(f, 0, SEEK_SET) != 0 || fread(&h, sizeof(h), 1, f) != 1
+        || memcmp(h.magic, ROLLUP_MAGIC, 8) != 0 || h.version != ROLLUP_VERSION
+        || h.record_size != sizeof(RollupRecord)) {
+        fclose(f);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    *out = f;
+    return (size - (long)sizeof(RollupHeader)) / (long)sizeof(RollupRecord);
+}
+
+static int rollup_read(FILE *f, long idx, RollupRecord *r) {
+    if (fseek(f, (long)sizeof(RollupHeader) + idx * (long)sizeof(RollupRecord), SEEK_SET) != 0) return 0;
+    return fread(r, sizeof(*r), 1, f) == 1;
+}
+
+static int rollup_write(FILE *f, long idx, const RollupRecord *r) {
+    if (fseek(f, (long)sizeof(RollupHeader) + idx * (long)sizeof(RollupRecord), SEEK_SET) != 0) return 0;
+    return fwrite(r, sizeof(*r), 1, f) == 1;
+}
+
+// Erster Datensatz mit period_start >= p (binäre Suche über die Datei)
+static long rollup_lower_bound(FILE *f, long count, int64_t p) {
+    long lo = 0;
+    long hi = count;
+    RollupRecord r;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (!rollup_read(f, mid, &r)) return count;
+        if (r.period_start < p) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Eine Session in die Rollup-Datei einer Granularität eintragen
+static void rollup_add(int gran, time_t t, double wpm, double accuracy, long chars) {
+    FILE *f;
+    long count = rollup_open(rollup_files[gran], &f, 1);
+    int64_t p = (int64_t)rollup_period(t, gran);
+    RollupRecord r;
+    long pos;
+    if (count < 0) return;
+
+    // Normalfall: gleiche oder neuere Periode als der letzte Datensatz
+    if (count > 0 && rollup_read(f, count - 1, &r) && r.period_start <= p) {
+        pos = (r.period_start == p) ? count - 1 : count;
+    } else {
+        pos = rollup_lower_bound(f, count, p);
+    }
+    if (pos < count && rollup_read(f, pos, &r) && r.period_start == p) {
+        rollup_merge_record(&r, wpm, accuracy, chars);
+        rollup_write(f, pos, &r);
+    } else {
+        // neuer Datensatz; liegt er nicht am Ende (Uhr zurückgestellt), wird der Rest nach hinten geschoben
+        long i;
+        memset(&r, 0, sizeof(r));
+        r.period_start = p;
+        rollup_merge_record(&r, wpm, accuracy, chars);
+        for (i = count; i > pos; i--) {
+            RollupRecord tmp;
+            if (!rollup_read(f, i - 1, &tmp) || !rollup_write(f, i, &tmp)) break;
+        }
+        rollup_write(f, pos, &r);
+    }
+    fclose(f);
+}
+
+static void rollup_add_row(void *ctx, time_t t, double wpm, double accuracy, long chars) {
+    if (t != (time_t)-1) rollup_add(*(int *)ctx, t, wpm, accuracy, chars);
+}
+
+// Fehlen Rollup-Dateien, werden sie einmalig aus Archiv und stats.txt aufgebaut
+static void rollups_ensure(void) {
+    int gran;
+    for (gran = 0; gran < ROLLUP_COUNT; gran++) {
+        FILE *f;
+        if (rollup_open(rollup_files[gran], &f, 0) >= 0) {
+            fclose(f);
+            continue;
+        }
+        remove(rollup_files[gran]); // ungültige Datei ersetzen
+        if (rollup_open(rollup_files[gran], &f, 1) < 0) continue;
+        fclose(f);
+        stats_foreach(rollup_add_row, &gran);
+    }
+}
+
+// Bezeichnung einer Periode, z.B. "2026-01-05", "2026-W02", "2026-01"
+static void rollup_label(time_t p, int gran, char *buf, size_t size) {
+    struct tm *tm_info = localtime(&p);
+    const char *fmt = (gran == ROLLUP_WEEK) ? "%G-W%V" : (gran == ROLLUP_MONTH) ? "%Y-%m" : "%Y-%m-%d";
+    strftime(buf, size, fmt, tm_info);
+}
+
+// --stats [--since DATE] [--until DATE] [--group-by day|week|month]
+static int stats_query(time_t since, time_t until, int gran) {
+    FILE *f;
+    long count, pos;
+    RollupRecord r;
+    RollupRecord total;
+    int64_t from, to;
+
+    rollups_ensure();
+    count = rollup_open(rollup_files[gran], &f, 0);
+    if (count < 0) {
+        printf("No statistics recorded yet.\n");
+        return 1;
+    }
+    from = (since == (time_t)-1) ? INT64_MIN : (int64_t)rollup_period(since, gran);
+    to = (until == (time_t)-1) ? INT64_MAX : (int64_t)until;
+    memset(&total, 0, sizeof(total));
+
+    printf("%-12s %8s %10s %10s %10s %10s\n", rollup_names[gran], "sessions", "avg WPM", "best WPM", "avg acc", "chars");
+    for (pos = rollup_lower_bound(f, count, from); pos < count && rollup_read(f, pos, &r); pos++) {
+        char label[32];
+        if (r.period_start > to) break;
+        rollup_label((time_t)r.period_start, gran, label, sizeof(label));
+        printf("%-12s %8u %10.2f %10.2f %9.2f%% %10lld\n", label, r.sessions,
+               r.sessions ? r.sum_wpm / r.sessions : 0.0, r.best_wpm,
+               r.sessions ? r.sum_acc / r.sessions : 0.0, (long long)r.chars);
+        total.sessions += r.sessions;
+        total.sum_wpm += r.sum_wpm;
+        total.sum_acc += r.sum_acc;
+        total.chars += r.chars;
+        if (r.best_wpm > total.best_wpm) total.best_wpm = r.best_wpm;
+    }
+    fclose(f);
+    printf("%-12s %8u %10.2f %10.2f %9.2f%% %10lld\n", "total", total.sessions,
+           total.sessions ? total.sum_wpm / total.sessions : 0.0, total.best_wpm,
+           total.sessions ? total.sum_acc / total.sessions : 0.0, (long long)total.chars);
+    return 0;
+}
+
+static void sketch_add_row(void *ctx, time_t t, double wpm, double accuracy, long chars) {
+    (void)t;
+    (void)chars;
+    sketches_record((SketchSet *)ctx, NULL, wpm, accuracy);
+}
+
+// ---------- Rangliste über mehrere Benutzer ----------
+// Mehrere Benutzer (z.B. eine Klasse) teilen sich eine Datei (--board PATH oder TT_LEADERBOARD) mit der
+// besten WPM pro Benutzer. Die WPM werden auf BOARD_STEP gerundet, ein Fenwick-Baum über diese Stufen
+// zählt die Benutzer pro Stufe: Rang und Top-N kosten O(log B) statt alle stats.txt zu lesen.
+// Die Datei wird per mmap direkt geändert, flock schützt gleichzeitige Zugriffe.
+// Aufbau (alles in Host-Byte-Reihenfolge):
+//   BoardHeader
+//   uint32_t tree[BOARD_BUCKETS + 1]  Fenwick-Baum (1-basiert): Benutzer pro Stufe
+//   uint32_t head[BOARD_BUCKETS]      erster Benutzer der Stufe + 1 (0 = keiner)
+//   BoardUser users[cap]
+//   uint32_t index[2 * cap]           Hash-Index über die Namen (Benutzer + 1, 0 = leer, lineares Sondieren)
+// Der Index liegt hinter den Benutzern und wird nur beim Vergrössern neu aufgebaut. Dateien der
+// Version 1 (ohne Index) werden beim ersten Schreiben ergänzt, beim Lesen wird linear gesucht.
+
+#define BOARD_FILE "leaderboard.bin"
+#define BOARD_MAGIC "TTBOARD\n"
+#define BOARD_VERSION 2
+#define BOARD_STEP 0.1          // WPM pro Stufe
+#define BOARD_BUCKETS 4096      // Zweierpotenz, deckt 0 bis 409.5 WPM ab (darüber: oberste Stufe)
+#define BOARD_NAME 32
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t buckets;
+    uint32_t n;                 // eingetragene Benutzer
+    uint32_t cap;               // Platz für Benutzer in der Datei
+} BoardHeader;
+
+typedef struct {
+    char name[BOARD_NAME];
+    double best_wpm;
+    uint32_t bucket;
+    uint32_t prev;              // Nachbarn in der Liste der Stufe (+1, 0 = keiner)
+    uint32_t next;
+    uint32_t pad;
+} BoardUser;
+
+typedef struct {
+    int fd;
+    unsigned char *map;
+    size_t len;
+    BoardHeader *h;
+    uint32_t *tree;
+    uint32_t *head;
+    BoardUser *users;
+    uint32_t *index;            // NULL bei Version 1
+} Board;
+
+static const char *board_path = BOARD_FILE;
+static char board_user[BOARD_NAME] = "user";
+
+static size_t board_size(uint32_t version, uint32_t cap) {
+    return sizeof(BoardHeader) + (BOARD_BUCKETS + 1) * sizeof(uint32_t) + BOARD_BUCKETS * sizeof(uint32_t) +
+           (size_t)cap * sizeof(BoardUser) + (version >= 2 ? (size_t)cap * 2 * sizeof(uint32_t) : 0);
+}
+
+static void board_bind(Board *b) {
+    b->h = (BoardHeader*)b->map;
+    b->tree = (uint32_t*)(b->map + sizeof(BoardHeader));
+    b->head = b->tree + BOARD_BUCKETS + 1;
+    b->users = (BoardUser*)(b->head + BOARD_BUCKETS);
+    b->index = (b->h->version >= 2) ? (uint32_t*)(b->users + b->h->cap) : NULL;
+}
+
+// FNV-1a über den Namen (höchstens BOARD_NAME Bytes, auch ohne abschliessendes '\0')
+static uint32_t board_name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < BOARD_NAME && name[i] != '\0'; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void board_index_put(Board *b, uint32_t u) {
+    uint32_t mask = b->h->cap * 2 - 1;
+    uint32_t s = board_name_hash(b->users[u].name) & mask;
+    while (b->index[s] != 0) s = (s + 1) & mask;
+    b->index[s] = u + 1;
+}
+
+static void board_index_rebuild(Board *b) {
+    uint32_t u;
+    memset(b->index, 0, (size_t)b->h->cap * 2 * sizeof(uint32_t));
+    for (u = 0; u < b->h->n; u++) board_index_put(b, u);
+}
+
+// schliessen gibt auch die Sperre frei
+static void board_close(Board *b) {
+    munmap(b->map, b->len);
+    close(b->fd);
+}
+
+// Datei auf len Bytes bringen und neu mappen (Schreibzugriff, Sperre wird gehalten)
+static int board_remap(Board *b, size_t len) {
+    munmap(b->map, b->len);
+    if (ftruncate(b->fd, (off_t)len) != 0) {
+        perror("leaderboard");
+        b->map = mmap(NULL, b->len, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+        if (b->map == MAP_FAILED) {
+            printf("Fehler bei mmap\n");
+            exit(1);
+        }
+        board_bind(b);
+        return 0;
+    }
+    b->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+    if (b->map == MAP_FAILED) {
+        printf("Fehler bei mmap\n");
+        exit(1);
+    }
+    b->len = len;
+    board_bind(b);
+    return 1;
+}
+
+static uint32_t board_bucket(double wpm) {
+    double q = wpm / BOARD_STEP + 0.5;
+    if (q < 0.0) return 0;
+    if (q >= BOARD_BUCKETS - 1) return BOARD_BUCKETS - 1;
+    return (uint32_t)q;
+}
+
+// Rangliste öffnen und sperren (write: exklusiv, Datei wird bei Bedarf angelegt).
+// Rückgabe 0 wenn es keine (gültige) Rangliste gibt
+static int board_open(Board *b, int write) {
+    struct stat st;
+    memset(b, 0, sizeof(*b));
+    b->fd = open(board_path, write ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if (b->fd < 0) return 0;
+    if (flock(b->fd, write ? LOCK_EX : LOCK_SH) != 0 || fstat(b->fd, &st) != 0) {
+        close(b->fd);
+        return 0;
+    }
+    if (st.st_size == 0 && write) {
+        BoardHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, BOARD_MAGIC, 8);
+        h.version = BOARD_VERSION;
+        h.buckets = BOARD_BUCKETS;
+        h.cap = 64;
+        if (ftruncate(b->fd, (off_t)board_size(h.version, h.cap)) != 0 || pwrite(b->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+            perror("leaderboard");
+            close(b->fd);
+            return 0;
+        }
+        st.st_size = (off_t)board_size(h.version, h.cap);
+    }
+    if ((size_t)st.st_size < board_size(1, 0)) {
+        close(b->fd);
+        return 0;
+    }
+    b->len = (size_t)st.st_size;
+    b->map = mmap(NULL, b->len, write ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, b->fd, 0);
+    if (b->map == MAP_FAILED) {
+        close(b->fd);
+        return 0;
+    }
+    board_bind(b);
+    if (memcmp(b->h->magic, BOARD_MAGIC, 8) != 0 || b->h->version < 1 || b->h->version > BOARD_VERSION ||
+        b->h->buckets != BOARD_BUCKETS || b->h->cap == 0 || (b->h->cap & (b->h->cap - 1)) != 0 ||
+        b->h->n > b->h->cap || board_size(b->h->version, b->h->cap) != b->len) {
+        printf("%s is not a valid leaderboard.\n", board_path);
+        munmap(b->map, b->len);
+        close(b->fd);
+        return 0;
+    }
+    if (write && b->h->version < BOARD_VERSION) {
+        // Version 1: Namensindex anhängen
+        if (!board_remap(b, board_size(BOARD_VERSION, b->h->cap))) {
+            board_close(b);
+            return 0;
+        }
+        b->h->version = BOARD_VERSION;
+        board_bind(b);
+        board_index_rebuild(b);
+    }
+    return 1;
+}
+
+// Platz für Benutzer verdoppeln. Die Benutzer bleiben an ihrem Platz, der Index dahinter wird neu aufgebaut
+static int board_grow(Board *b) {
+    uint32_t cap = b->h->cap * 2;
+    if (!board_remap(b, board_size(BOARD_VERSION, cap))) return 0;
+    b->h->cap = cap;
+    board_bind(b);
+    board_index_rebuild(b);
+    return 1;
+}
+
+// Fenwick: Anzahl in Stufe bucket um delta ändern
+static void board_tree_add(Board *b, uint32_t bucket, int32_t delta) {
+    uint32_t i;
+    for (i = bucket + 1; i <= BOARD_BUCKETS; i += i & (~i + 1)) b->tree[i] += (uint32_t)delta;
+}
+
+// Benutzer in den Stufen 0..bucket
+static uint32_t board_prefix(const Board *b, uint32_t bucket) {
+    uint32_t i, sum = 0;
+    for (i = bucket + 1; i > 0; i -= i & (~i + 1)) sum += b->tree[i];
+    return sum;
+}
+
+// Stufe des k-kleinsten Eintrags (k ab 1), per Binärabstieg im Fenwick-Baum
+static uint32_t board_kth(const Board *b, uint32_t k) {
+    uint32_t pos = 0, step;
+    for (step = BOARD_BUCKETS; step > 0; step >>= 1) {
+        if (pos + step <= BOARD_BUCKETS && b->tree[pos + step] < k) {
+            pos += step;
+            k -= b->tree[pos];
+        }
+    }
+    return pos;   // 0-basiert
+}
+
+// Rang eines Benutzers mit Stufe bucket: 1 + Anzahl Benutzer in höheren Stufen
+static uint32_t board_rank(const Board *b, uint32_t bucket) {
+    return b->h->n - board_prefix(b, bucket) + 1;
+}
+
+// Benutzer über den Namensindex suchen (Version 1 ohne Index: linear)
+static long board_find(const Board *b, const char *name) {
+    uint32_t i;
+    if (b->index != NULL) {
+        uint32_t mask = b->h->cap * 2 - 1;
+        uint32_t s = board_name_hash(name) & mask;
+        while (b->index[s] != 0) {
+            if (strncmp(b->users[b->index[s] - 1].name, name, BOARD_NAME) == 0) return (long)b->index[s] - 1;
+            s = (s + 1) & mask;
+        }
+        return -1;
+    }
+    for (i = 0; i < b->h->n; i++) {
+        if (strncmp(b->users[i].name, name, BOARD_NAME) == 0) return (long)i;
+    }
+    return -1;
+}
+
+static void board_link(Board *b, uint32_t u) {
+    BoardUser *p = &b->users[u];
+    p->prev = 0;
+    p->next = b->head[p->bucket];
+    if (p->next != 0) b->users[p->next - 1].prev = u + 1;
+    b->head[p->bucket] = u + 1;
+    board_tree_add(b, p->bucket, 1);
+}
+
+static void board_unlink(Board *b, uint32_t u) {
+    BoardUser *p = &b->users[u];
+    if (p->prev != 0) b->users[p->prev - 1].next = p->next;
+    else b->head[p->bucket] = p->next;
+    if (p->next != 0) b->users[p->next - 1].prev = p->prev;
+    board_tree_add(b, p->bucket, -1);
+}
+
+static void board_best_row(void *ctx, time_t t, double wpm, double accuracy, long chars) {
+    double *best = ctx;
+    (void)t;
+    (void)accuracy;
+    (void)chars;
+    if (wpm > *best) *best = wpm;
+}
+
+// Neue Session-WPM des aktuellen Benutzers eintragen, wenn sie seine Bestleistung ist.
+// Ein neuer Benutzer startet mit der besten WPM aus seiner bisherigen Statistik
+static void board_record(double wpm) {
+    Board b;
+    long u;
+    if (!board_open(&b, 1)) return;
+    u = board_find(&b, board_user);
+    if (u < 0) {
+        BoardUser *p;
+        if (b.h->n == b.h->cap && !board_grow(&b)) {
+            board_close(&b);
+            return;
+        }
+        stats_foreach(board_best_row, &wpm);
+        u = (long)b.h->n++;
+        p = &b.users[u];
+        memset(p, 0, sizeof(*p));
+        memcpy(p->name, board_user, sizeof(p->name));   // board_user ist nullterminiert und gleich gross
+        board_index_put(&b, (uint32_t)u);
+    } else if (wpm > b.users[u].best_wpm) {
+        board_unlink(&b, (uint32_t)u);
+    } else {
+        board_close(&b);
+        return;
+    }
+    b.users[u].best_wpm = wpm;
+    b.users[u].bucket = board_bucket(wpm);
+    board_link(&b, (uint32_t)u);
+    board_close(&b);
+}
+
+// Eigene Platzierung in einer Zeile (für die Statistik), nichts wenn nicht eingetragen
+static void board_show_self(void) {
+    Board b;
+    long u;
+    if (!board_open(&b, 0)) return;
+    u = board_find(&b, board_user);
+    if (u >= 0) {
+        const BoardUser *p = &b.users[u];
+        uint32_t below = (p->bucket > 0) ? board_prefix(&b, p->bucket - 1) : 0;
+        printf("Leaderboard: rank %u of %u (better than %.1f%% of users)\n", board_rank(&b, p->bucket), b.h->n,
+               100.0 * below / b.h->n);
+    }
+    board_close(&b);
+}
+
+// --leaderboard: die besten n Benutzer und die eigene Platzierung
+static int board_show(int n) {
+    Board b;
+    uint32_t k = 1;
+    if (!board_open(&b, 0)) {
+        printf("No leaderboard at %s yet.\n", board_path);
+        return 1;
+    }
+    printf("Rank  %-*s %9s\n", BOARD_NAME, "User", "Best WPM");
+    while (k <= b.h->n && k <= (uint32_t)n) {
+        // Stufe des k-besten Benutzers, dann alle Benutzer dieser Stufe (gleicher Rang)
+        uint32_t bucket = board_kth(&b, b.h->n - k + 1);
+        uint32_t rank = k;
+        uint32_t u;
+        for (u = b.head[bucket]; u != 0 && k <= (uint32_t)n; u = b.users[u - 1].next, k++) {
+            printf("%4u  %-*.*s %9.2f\n", rank, BOARD_NAME, BOARD_NAME, b.users[u - 1].name, b.users[u - 1].best_wpm);
+        }
+        if (u != 0) break;
+    }
+    board_close(&b);
+    board_show_self();
+    return 0;
+}
+
+// Session-Statistiken anhängen (Format: "YYYY-MM-DDTHH:MM:SS,wpm,accuracy,chars\n"),
+// Rollups nachführen und in die Quantil-Sketches eintragen (mode z.B. "words", "sentences", "passage")
+static void append_session_stats(const char *mode, double wpm, double accuracy, long chars) {
+    SketchSet set = {NULL, 0};
+    // Läufe des synthetischen Tippers (--bench --save) gehören weder in die eigene Statistik noch in die
+    // Rangliste: stats.txt hat keine Modus-Spalte, ein neuer Ranglisten-Eintrag würde sie sonst übernehmen
+    if (strncmp(mode, "bench-", 6) == 0) return;
+    if (!sketches_load(&set, SKETCH_FILE)) {
+        // noch keine Sketches: bisherige Sessions einmalig übernehmen (Modus unbekannt)
+        stats_foreach(sketch_add_row, &set);
+    }
+
+    rollups_ensure();
+
+    FILE *f = stats_open_locked("a");
+    if (f == NULL) {
+        perror("fopen stats");
+        sketches_free(&set);
+        return;
+    }
+    time_t t = time(NULL);
+    struct tm *tm_info = localtime(&t);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", tm_info);
+    fprintf(f, "%s,%.2f,%.2f,%ld\n", buf, wpm, accuracy, chars);
+    fclose(f);
+
+    {
+        // gleiche Rundung wie in stats.txt, damit ein Neuaufbau aus stats.txt dieselben Summen ergibt
+        char num[64];
+        double wpm_r, acc_r;
+        int gran;
+        snprintf(num, sizeof(num), "%.2f", wpm);
+        wpm_r = strtod(num, NULL);
+        snprintf(num, sizeof(num), "%.2f", accuracy);
+        acc_r = strtod(num, NULL);
+        for (gran = 0; gran < ROLLUP_COUNT; gran++) rollup_add(gran, t, wpm_r, acc_r, chars);
+    }
+
+    sketches_record(&set, mode, wpm, accuracy);
+    sketches_save(&set, SKETCH_FILE);
+    sketches_free(&set);
+    board_record(wpm);
+}
+
+// Agregierte Statistiken berechnen
+static void compute_aggregate_stats(double *avg_wpm, double *best_wpm, double *avg_acc, size_t *sessions) {
+    FILE *f;
+    double wpm, acc;
+    long ch;
+
+    *avg_wpm = 0.0;
+    *best_wpm = 0.0;
+    *avg_acc = 0.0;
+    *sessions = 0;
+
+    // archivierte Sessions: nur die Summen aus den Blockköpfen
+    archive_totals(sessions, avg_wpm, best_wpm, avg_acc);
+
+    f = fopen(STATS_FILE, "r"); //öffnen im read modus
+    if (f != NULL) {
+        //fscanf > gibt die Anzahl erfolgreich eingelesener Felder zurück
+        while (fscanf(f, "%*[^,],%lf,%lf,%ld\n", &wpm, &acc, &ch) == 3) { //Datum wird eingelesen (Kommas werden ignoriert) auser am Ende werden zwei Double und ein Long mit Kommatrennung und dann ein Zeilenumbruch
+            (*sessions)++;
+            *avg_wpm += wpm;
+            *avg_acc += acc;
+            if (wpm > *best_wpm) {
+                *best_wpm = wpm;
+            }
+        }
+        fclose(f);
+    }
+
+    if (*sessions > 0) {
+        *avg_wpm /= (double)(*sessions);
+        *avg_acc /= (double)(*sessions);
+    }
+}
+
+// Entferne Newline am ende einer Zeile
+static void trim_newline(char *s) {
+    if (s == NULL) return;
+    size_t l = strlen(s);
+    if (l == 0) return;
+    if (s[l-1] == '\n') {
+        s[l-1] = '\0';
+        l--;
+    }
+    if (l > 0 && s[l-1] == '\r') {
+        s[l-1] = '\0';
+    }
+}
+
+// Benötigte Zeit in Sekunden zwischen zwei timevals berechnen
+static double elapsed_seconds(struct timeval start, struct timeval end) {
+    double s = (double)(end.tv_sec - start.tv_sec);
+    double us = (double)(end.tv_usec - start.tv_usec) / 1000000.0;
+    return s + us;
+}
+
+// ---------- Arena für Daten, die nur während eines Items leben ----------
+// Bump-Allocator: arena_alloc schiebt nur einen Zeiger weiter, arena_reset gibt alles auf einmal frei.
+// Reicht der Block nicht, wird ein grösserer angelegt, die alten bleiben bis zum Reset gültig.
+// Beim Reset werden sie durch einen Block der Gesamtgrösse ersetzt. Sobald dieser gross genug ist,
+// läuft jedes weitere Item ohne malloc/free.
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *prev;
+    size_t cap;
+    size_t used;
+    unsigned char *data;
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+    size_t total;           // Kapazität aller Blöcke
+} Arena;
+
+static Arena item_arena;    // wird pro geübtem Item zurückgesetzt
+
+static ArenaBlock *arena_block_new(size_t cap) {
+    // Kopf und Daten in einer Allokation, Daten auf ARENA_ALIGN ausgerichtet
+    size_t head = (sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *b = malloc(head + cap);
+    if (b == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    b->prev = NULL;
+    b->cap = cap;
+    b->used = 0;
+    b->data = (unsigned char *)b + head;
+    return b;
+}
+
+static void *arena_alloc(Arena *a, size_t size) {
+    void *p;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (a->head == NULL || a->head->cap - a->head->used < size) {
+        size_t cap = (a->total < ARENA_MIN_BLOCK) ? ARENA_MIN_BLOCK : a->total;
+        ArenaBlock *b;
+        while (cap < size) cap *= 2;
+        b = arena_block_new(cap);
+        b->prev = a->head;
+        a->head = b;
+        a->total += cap;
+    }
+    p = a->head->data + a->head->used;
+    a->head->used += size;
+    return p;
+}
+
+static char *arena_strdup(Arena *a, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = arena_alloc(a, len);
+    memcpy(copy, s, len);
+    return copy;
+}
+
+// Alles freigeben, was seit dem letzten Reset angelegt wurde
+static void arena_reset(Arena *a) {
+    if (a->head == NULL) return;
+    if (a->head->prev != NULL) {
+        // mehrere Blöcke: durch einen einzigen der Gesamtgrösse ersetzen
+        size_t total = a->total;
+        while (a->head != NULL) {
+            ArenaBlock *prev = a->head->prev;
+            free(a->head);
+            a->head = prev;
+        }
+        a->head = arena_block_new(total);
+        a->total = total;
+    }
+    a->head->used = 0;
+}
+
+// Struct für vergleichsergebnisse
+typedef struct {
+    size_t correct_chars;
+    size_t total_chars;
+    size_t correct_words;
+    size_t total_words;
+    KeyCount *wrong;        // falsche Wörter mit Anzahl (in der Arena)
+    size_t n_wrong;
+    size_t deleted_words;      // Referenzwörter, die ausgelassen wurden
+    size_t inserted_words;     // getippte Wörter ohne Gegenstück in der Referenz
+    size_t substituted_words;  // Referenzwörter, an deren Stelle etwas anderes getippt wurde
+} CompareResult;
+
+// Wörter im Text sammeln, Anzahl zurückgeben. text wird verändert: Leerraum nach einem Wort wird zu '\0',
+// words zeigt auf ein Array in der Arena mit einem Eintrag pro Wort
+static size_t collect_words(Arena *a, char *text, char ***words) {
+    size_t count = 0;
+    char *p = text;
+    int in_word = 0;
+    // erst zählen, damit das Array in einem Stück aus der Arena kommt
+    for (p = text; *p; p++) {
+        int space = isspace((unsigned char)*p);
+        if (!space && !in_word) count++;
+        in_word = !space;
+    }
+    *words = arena_alloc(a, (count + 1) * sizeof(char *));
+    count = 0;
+    p = text;
+    while (*p) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        (*words)[count++] = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+        if (*p) *p++ = '\0';
+    }
+    return count;
+}
+
+// ---------- Fehlermodell nach Kontext (Zeichenpaare und -tripel) ----------
+// mistakes_chars.txt zählt nur das einzelne Zeichen. Viele Fehler passieren aber erst nach einem
+// bestimmten Vorgänger, daher werden hier Versuche und Fehler pro Zielzeichen der Referenz mit seinem
+// Vorgänger (Paar) bzw. den zwei Vorgängern (Tripel) gezählt. Zeichen sind Latin-1, der Wortanfang hat
+// das Leerzeichen als Vorgänger. Paare liegen in einer dichten 256x256 Tabelle, Tripel in einer
+// Hashtabelle mit offener Adressierung: jedes Update ist O(1).
+// Datei: "2\tvorher\tziel\tversuche\tfehler" bzw. "3\tvor2\tvor1\tziel\tversuche\tfehler" (Zeichencodes)
+
+#define NGRAM_FILE "mistakes_ngrams.txt"
+#define NGRAM_WORD_MAX 64       // längere Wörter: nur die ersten Zeichen werden gezählt
+#define NGRAM_MIN_ATTEMPTS 5    // für die Auswertung "schlechteste Übergänge"
+
+typedef struct {
+    uint32_t attempts;
+    uint32_t errors;
+} NgramCount;
+
+typedef struct {
+    uint32_t key;           // 0 = leer, sonst 1 << 24 | vor2 << 16 | vor1 << 8 | ziel
+    NgramCount c;
+} NgramSlot;
+
+static NgramCount *ngram_bi = NULL;     // [vorher * 256 + ziel]
+static NgramSlot *ngram_tri = NULL;
+static size_t ngram_tri_cap = 0;        // Zweierpotenz
+static size_t ngram_tri_n = 0;
+
+// Nächstes Zeichen aus UTF-8 lesen (nur 1- und 2-Byte-Folgen bis 0xFF), -1 sonst
+static int latin1_next(const char **p, size_t avail) {
+    const unsigned char *s = (const unsigned char *)*p;
+    if (avail == 0) return -1;
+    if (s[0] < 0x80) {
+        *p += 1;
+        return s[0];
+    }
+    if ((s[0] == 0xC2 || s[0] == 0xC3) && avail >= 2 && (s[1] & 0xC0) == 0x80) {
+        *p += 2;
+        return ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    }
+    return -1;
+}
+
+// Zeichen (Codepoint) als UTF-8 Text zum Anzeigen (Leerzeichen als "SPC")
+static const char *char_show(int c, char out[5]) {
+    if (c == ' ') return "SPC";
+    if (c < 0x80) {
+        out[0] = (char)c;
+        out[1] = '\0';
+    } else if (c < 0x800) {
+        out[0] = (char)(0xC0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3F));
+        out[2] = '\0';
+    } else if (c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (c & 0x3F));
+        out[3] = '\0';
+    } else {
+        out[0] = (char)(0xF0 | (c >> 18));
+        out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (c & 0x3F));
+        out[4] = '\0';
+    }
+    return out;
+}
+
+// Wort in Codepoints zerlegen (ungültige UTF-8 Bytes einzeln), Rückgabe Anzahl
+static size_t word_decode(const char *word, int *out) {
+    const unsigned char *p = (const unsigned char *)word;
+    size_t n = 0;
+    while (*p && n < NGRAM_WORD_MAX) {
+        int c = *p;
+        int len = (c < 0x80) ? 1 : ((c & 0xE0) == 0xC0) ? 2 : ((c & 0xF0) == 0xE0) ? 3 : ((c & 0xF8) == 0xF0) ? 4 : 0;
+        int k;
+        if (len > 1) {
+            c &= 0x3F >> (len - 1);
+            for (k = 1; k < len && (p[k] & 0xC0) == 0x80; k++) c = (c << 6) | (p[k] & 0x3F);
+            if (k < len) len = 0;
+        }
+        if (len == 0) {
+            c = *p;
+            len = 1;
+        }
+        p += len;
+        out[n++] = c;
+    }
+    return n;
+}
+
+static NgramCount *ngram_tri_slot(uint32_t key) {
+    size_t i;
+    if ((ngram_tri_n + 1) * 4 > ngram_tri_cap * 3) {
+        // wachsen und neu einsortieren
+        size_t cap = ngram_tri_cap ? ngram_tri_cap * 2 : 4096;
+        NgramSlot *t = calloc(cap, sizeof(NgramSlot));
+        size_t j;
+        if (t == NULL) {
+            printf("Fehler bei calloc\n");
+            exit(1);
+        }
+        for (j = 0; j < ngram_tri_cap; j++) {
+            if (ngram_tri[j].key == 0) continue;
+            i = (ngram_tri[j].key * 2654435761u) & (cap - 1);
+            while (t[i].key != 0) i = (i + 1) & (cap - 1);
+            t[i] = ngram_tri[j];
+        }
+        free(ngram_tri);
+        ngram_tri = t;
+        ngram_tri_cap = cap;
+    }
+    i = (key * 2654435761u) & (ngram_tri_cap - 1);
+    while (ngram_tri[i].key != 0 && ngram_tri[i].key != key) i = (i + 1) & (ngram_tri_cap - 1);
+    if (ngram_tri[i].key == 0) {
+        ngram_tri[i].key = key;
+        ngram_tri_n++;
+    }
+    return &ngram_tri[i].c;
+}
+
+static void ngram_init(void) {
+    if (ngram_bi != NULL) return;
+    ngram_bi = calloc(256 * 256, sizeof(NgramCount));
+    if (ngram_bi == NULL) {
+        printf("Fehler bei calloc\n");
+        exit(1);
+    }
+}
+
+// Ein Versuch auf Zielzeichen c[k] (k = Position im Wort), Zeichen ausserhalb Latin-1 zählen nicht
+static void ngram_hit(const int *c, size_t k, int error) {
+    int p1 = (k > 0) ? c[k - 1] : ' ';
+    NgramCount *b;
+    if (c[k] > 0xFF || p1 > 0xFF) return;
+    b = &ngram_bi[p1 * 256 + c[k]];
+    b->attempts++;
+    b->errors += (uint32_t)error;
+    if (k > 0) {
+        int p2 = (k > 1) ? c[k - 2] : ' ';
+        if (p2 > 0xFF) return;
+        NgramCount *t = ngram_tri_slot(1u << 24 | (uint32_t)p2 << 16 | (uint32_t)p1 << 8 | (uint32_t)c[k]);
+        t->attempts++;
+        t->errors += (uint32_t)error;
+    }
+}
+
+// ---------- Verwechslungsmatrix: welche Taste statt der richtigen getroffen wurde ----------
+// Zählt Paare (gewollt, getippt) bei ersetzten Zeichen. ASCII liegt dicht in einer 128x128 Tabelle
+// (ein Inkrement pro Fehler), alle anderen Codepoints in einer kleinen Hashtabelle.
+// Datei: "gewollt\tgetippt\tanzahl" (Codepoints)
+
+#define CONFUSION_FILE "mistakes_confusion.txt"
+
+typedef struct {
+    uint64_t key;           // 0 = leer, sonst 1 << 42 | gewollt << 21 | getippt
+    uint32_t count;
+} ConfusionSlot;
+
+static uint32_t confusion_ascii[128 * 128];
+static ConfusionSlot *confusion_wide = NULL;
+static size_t confusion_wide_cap = 0;   // Zweierpotenz
+static size_t confusion_wide_n = 0;
+static int confusion_dirty = 0;         // nur speichern, wenn geladen oder gezählt
+
+static uint32_t *confusion_wide_slot(uint64_t key) {
+    size_t i;
+    if ((confusion_wide_n + 1) * 4 > confusion_wide_cap * 3) {
+        size_t cap = confusion_wide_cap ? confusion_wide_cap * 2 : 256;
+        ConfusionSlot *t = calloc(cap, sizeof(ConfusionSlot));
+        size_t j;
+        if (t == NULL) {
+            printf("Fehler bei calloc\n");
+            exit(1);
+        }
+        for (j = 0; j < confusion_wide_cap; j++) {
+            if (confusion_wide[j].key == 0) continue;
+            i = (size_t)((confusion_wide[j].key * 0x9E3779B97F4A7C15ull) >> 40) & (cap - 1);
+            while (t[i].key != 0) i = (i + 1) & (cap - 1);
+            t[i] = confusion_wide[j];
+        }
+        free(confusion_wide);
+        confusion_wide = t;
+        confusion_wide_cap = cap;
+    }
+    i = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 40) & (confusion_wide_cap - 1);
+    while (confusion_wide[i].key != 0 && confusion_wide[i].key != key) i = (i + 1) & (confusion_wide_cap - 1);
+    if (confusion_wide[i].key == 0) {
+        confusion_wide[i].key = key;
+        confusion_wide_n++;
+    }
+    return &confusion_wide[i].count;
+}
+
+static void confusion_add_n(int want, int got, uint32_t n) {
+    confusion_dirty = 1;
+    if (want < 128 && got < 128) {
+        confusion_ascii[want * 128 + got] += n;
+    } else {
+        *confusion_wide_slot(1ull << 42 | (uint64_t)want << 21 | (uint64_t)got) += n;
+    }
+}
+
+static void confusion_add(int want, int got) {
+    confusion_add_n(want, got, 1);
+}
+
+static void confusion_load(void) {
+    FILE *f = fopen(CONFUSION_FILE, "r");
+    int want, got;
+    unsigned long n;
+    if (f == NULL) return;
+    while (fscanf(f, "%d\t%d\t%lu\n", &want, &got, &n) == 3) {
+        if (want >= 0 && want <= 0x10FFFF && got >= 0 && got <= 0x10FFFF) confusion_add_n(want, got, (uint32_t)n);
+    }
+    fclose(f);
+}
+
+static void confusion_save(void) {
+    FILE *f;
+    size_t i;
+    if (!confusion_dirty) return;
+    f = fopen(CONFUSION_FILE, "w");
+    if (f == NULL) {
+        perror("fopen confusion");
+        return;
+    }
+    for (i = 0; i < 128 * 128; i++) {
+        if (confusion_ascii[i] != 0) fprintf(f, "%d\t%d\t%u\n", (int)(i / 128), (int)(i % 128), confusion_ascii[i]);
+    }
+    for (i = 0; i < confusion_wide_cap; i++) {
+        uint64_t k = confusion_wide[i].key;
+        if (k == 0) continue;
+        fprintf(f, "%d\t%d\t%u\n", (int)((k >> 21) & 0x1FFFFF), (int)(k & 0x1FFFFF), confusion_wide[i].count);
+    }
+    fclose(f);
+}
+
+// Die n häufigsten Verwechslungen
+static void show_top_confusions(int n) {
+    ConfusionSlot *rows;
+    size_t count = 0, i;
+    rows = malloc((128 * 128 + confusion_wide_cap + 1) * sizeof(ConfusionSlot));
+    if (rows == NULL) {
+        printf("Fehler bei malloc\n");
+        return;
+    }
+    for (i = 0; i < 128 * 128; i++) {
+        if (confusion_ascii[i] == 0) continue;
+        rows[count].key = (uint64_t)(i / 128) << 21 | (uint64_t)(i % 128);
+        rows[count++].count = confusion_ascii[i];
+    }
+    for (i = 0; i < confusion_wide_cap; i++) {
+        if (confusion_wide[i].key != 0) rows[count++] = confusion_wide[i];
+    }
+    printf("\nTop confusions (intended -> typed):\n");
+    if (count == 0) printf("  (none)\n");
+    // Teilauswahl: nur die ersten n nach vorne holen
+    for (i = 0; i < count && i < (size_t)n; i++) {
+        size_t best = i, k;
+        char s1[5], s2[5];
+        ConfusionSlot tmp;
+        for (k = i + 1; k < count; k++) {
+            if (rows[k].count > rows[best].count) best = k;
+        }
+        tmp = rows[i];
+        rows[i] = rows[best];
+        rows[best] = tmp;
+        printf("  %d) %s -> %-4s : %u\n", (int)i + 1, char_show((int)((rows[i].key >> 21) & 0x1FFFFF), s1),
+               char_show((int)(rows[i].key & 0x1FFFFF), s2), rows[i].count);
+    }
+    free(rows);
+}
+
+// Zeichenmodelle (Kontext und Verwechslungen) mit einem Referenzwort und dem dazu getippten Wort
+// (NULL = richtig getippt) nachführen. Welche Zeichen falsch sind, bestimmt dieselbe Heuristik
+// wie add_char_mistakes
+static void char_models_word(const char *ref_word, const char *typed_word) {
+    int r[NGRAM_WORD_MAX];
+    int t[NGRAM_WORD_MAX];
+    size_t rn = word_decode(ref_word, r);
+    size_t tn;
+    size_t i = 0, j = 0;
+
+    ngram_init();
+    if (typed_word == NULL) {
+        for (i = 0; i < rn; i++) ngram_hit(r, i, 0);
+        return;
+    }
+    tn = word_decode(typed_word, t);
+    while (i < rn) {
+        if (j < tn && r[i] == t[j]) {
+            ngram_hit(r, i++, 0);
+            j++;
+        } else if (j + 1 < tn && r[i] == t[j + 1]) {
+            j++;                        // Zeichen zu viel getippt, kein Versuch auf r[i]
+        } else if (j < tn && i + 1 < rn && r[i + 1] == t[j]) {
+            ngram_hit(r, i++, 1);       // r[i] ausgelassen
+        } else {
+            if (j < tn) confusion_add(r[i], t[j]);   // t[j] statt r[i] getroffen
+            ngram_hit(r, i++, 1);       // ersetzt oder fehlt am Ende
+            j++;
+        }
+    }
+}
+
+static void ngram_load(void) {
+    FILE *f = fopen(NGRAM_FILE, "r");
+    int order, a, b, c;
+    unsigned long att, err;
+    char line[128];
+    if (f == NULL) return;
+    ngram_init();
+    while (fgets(line, sizeof(line), f) != NULL) {
+        NgramCount *n = NULL;
+        if (sscanf(line, "%d", &order) != 1) continue;
+        if (order == 2 && sscanf(line, "%*d\t%d\t%d\t%lu\t%lu", &b, &c, &att, &err) == 4 &&
+            b >= 0 && b < 256 && c >= 0 && c < 256) {
+            n = &ngram_bi[b * 256 + c];
+        } else if (order == 3 && sscanf(line, "%*d\t%d\t%d\t%d\t%lu\t%lu", &a, &b, &c, &att, &err) == 5 &&
+                   a >= 0 && a < 256 && b >= 0 && b < 256 && c >= 0 && c < 256) {
+            n = ngram_tri_slot(1u << 24 | (uint32_t)a << 16 | (uint32_t)b << 8 | (uint32_t)c);
+        }
+        if (n != NULL) {
+            n->attempts += (uint32_t)att;
+            n->errors += (uint32_t)err;
+        }
+    }
+    fclose(f);
+}
+
+static void ngram_save(void) {
+    FILE *f;
+    size_t i;
+    if (ngram_bi == NULL) return;   // nichts geladen und nichts gezählt
+    f = fopen(NGRAM_FILE, "w");
+    if (f == NULL) {
+        perror("fopen ngrams");
+        return;
+    }
+    for (i = 0; i < 256 * 256; i++) {
+        if (ngram_bi[i].attempts == 0) continue;
+        fprintf(f, "2\t%d\t%d\t%u\t%u\n", (int)(i >> 8), (int)(i & 0xFF), ngram_bi[i].attempts, ngram_bi[i].errors);
+    }
+    for (i = 0; i < ngram_tri_cap; i++) {
+        uint32_t k = ngram_tri[i].key;
+        if (k == 0) continue;
+        fprintf(f, "3\t%d\t%d\t%d\t%u\t%u\n", (int)((k >> 16) & 0xFF), (int)((k >> 8) & 0xFF), (int)(k & 0xFF),
+                ngram_tri[i].c.attempts, ngram_tri[i].c.errors);
+    }
+    fclose(f);
+}
+
+typedef struct {
+    uint32_t key;           // wie im Tripel-Slot (Paare: vor2 = 0)
+    NgramCount c;
+} NgramRow;
+
+// höhere Fehlerrate zuerst, bei Gleichstand mehr Fehler
+static int cmp_ngram_rate(const void *a, const void *b) {
+    const NgramCount *x = &((const NgramRow *)a)->c;
+    const NgramCount *y = &((const NgramRow *)b)->c;
+    double rx = (double)x->errors / x->attempts;
+    double ry = (double)y->errors / y->attempts;
+    if (rx != ry) return (rx < ry) ? 1 : -1;
+    if (x->errors != y->errors) return (x->errors < y->errors) ? 1 : -1;
+    return 0;
+}
+
+// Die n schlechtesten Übergänge (Paare und Tripel) mit mindestens NGRAM_MIN_ATTEMPTS Versuchen
+static void show_worst_transitions(int n) {
+    NgramRow *rows;
+    size_t count, k, i;
+    int order;
+    if (ngram_bi == NULL) return;
+    rows = malloc((256 * 256 + ngram_tri_cap + 1) * sizeof(NgramRow));
+    if (rows == NULL) {
+        printf("Fehler bei malloc\n");
+        return;
+    }
+    for (order = 2; order <= 3; order++) {
+        count = 0;
+        if (order == 2) {
+            for (i = 0; i < 256 * 256; i++) {
+                if (ngram_bi[i].errors == 0 || ngram_bi[i].attempts < NGRAM_MIN_ATTEMPTS) continue;
+                rows[count].key = (uint32_t)i;
+                rows[count++].c = ngram_bi[i];
+            }
+        } else {
+            for (i = 0; i < ngram_tri_cap; i++) {
+                if (ngram_tri[i].c.errors == 0 || ngram_tri[i].c.attempts < NGRAM_MIN_ATTEMPTS) continue;
+                rows[count].key = ngram_tri[i].key;
+                rows[count++].c = ngram_tri[i].c;
+            }
+        }
+        if (count == 0) continue;
+        qsort(rows, count, sizeof(NgramRow), cmp_ngram_rate);
+        printf("\nWorst %s (at least %d attempts):\n", (order == 2) ? "transitions" : "three-key sequences",
+               NGRAM_MIN_ATTEMPTS);
+        for (k = 0; k < count && k < (size_t)n; k++) {
+            char s0[5], s1[5], s2[5];
+            uint32_t key = rows[k].key;
+            if (order == 2) {
+                printf("  %d) %s -> %-4s", (int)k + 1, char_show((int)(key >> 8), s1), char_show((int)(key & 0xFF), s2));
+            } else {
+                printf("  %d) %s %s -> %-4s", (int)k + 1, char_show((int)((key >> 16) & 0xFF), s0),
+                       char_show((int)((key >> 8) & 0xFF), s1), char_show((int)(key & 0xFF), s2));
+            }
+            printf(" %5.1f%%  (%u of %u)\n", 100.0 * rows[k].c.errors / rows[k].c.attempts, rows[k].c.errors,
+                   rows[k].c.attempts);
+        }
+    }
+    free(rows);
+}
+
+// ---------- Metriken im Prometheus-Textformat schreiben ----------
+
+static const Map *metrics_words = NULL;    // Fehler-Maps für die Messwerte (in main bzw. bench gesetzt)
+static const Map *metrics_chars = NULL;
+static time_t metrics_start = 0;
+static time_t metrics_last = 0;
+
+// Datei neu schreiben (temporär und umbenennen, ein Collector sieht nie eine halbe Datei)
+static void metrics_write(void) {
+    static const char *const files[] = { STATS_FILE, MWORDS_FILE, MCHARS_FILE, ARCHIVE_FILE, NGRAM_FILE, CONFUSION_FILE };
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    char tmp_path[512];
+    FILE *f;
+    size_t i, q;
+    struct stat st;
+
+    if (metrics_path == NULL) return;
+    metrics_last = time(NULL);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics_path);
+    f = fopen(tmp_path, "w");
+    if (f == NULL) return;
+    for (i = 0; i < MC_COUNT; i++) {
+        fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", metric_counter_names[i][0], metric_counter_names[i][1],
+                metric_counter_names[i][0], metric_counter_names[i][0],
+                (unsigned long long)__atomic_load_n(&metric_counters[i], __ATOMIC_RELAXED));
+    }
+    for (i = 0; i < MH_COUNT; i++) {
+        const LatencyHist *h = &metric_hists[i];
+        const char *name = metric_hist_names[i][0];
+        fprintf(f, "# HELP %s %s\n# TYPE %s summary\n", name, metric_hist_names[i][1], name);
+        for (q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(f, "%s{quantile=\"%g\"} %.9f\n", name, quantiles[q], hist_quantile(h, quantiles[q]));
+        }
+        fprintf(f, "%s_sum %.9f\n%s_count %llu\n", name, (double)__atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9,
+                name, (unsigned long long)__atomic_load_n(&h->n, __ATOMIC_RELAXED));
+    }
+    fprintf(f, "# HELP tt_map_entries Distinct keys in the mistake maps.\n# TYPE tt_map_entries gauge\n");
+    fprintf(f, "tt_map_entries{map=\"words\"} %zu\n", metrics_words ? metrics_words->n : 0);
+    fprintf(f, "tt_map_entries{map=\"chars\"} %zu\n", metrics_chars ? metrics_chars->n : 0);
+    fprintf(f, "# HELP tt_file_bytes Size of the trainer's data files.\n# TYPE tt_file_bytes gauge\n");
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        fprintf(f, "tt_file_bytes{file=\"%s\"} %lld\n", files[i], stat(files[i], &st) == 0 ? (long long)st.st_size : 0LL);
+    }
+    fprintf(f, "# HELP tt_start_time_seconds Process start time since the epoch.\n# TYPE tt_start_time_seconds gauge\n");
+    fprintf(f, "tt_start_time_seconds %lld\n", (long long)metrics_start);
+    if (fclose(f) == 0) {
+        rename(tmp_path, metrics_path);
+    } else {
+        remove(tmp_path);
+    }
+}
+
+// Bei Aktivität aufrufen: schreibt höchstens alle METRICS_INTERVAL Sekunden
+static void metrics_tick(void) {
+    if (metrics_path != NULL && time(NULL) - metrics_last >= METRICS_INTERVAL) metrics_write();
+}
+
+// Fehler von falschen Wortpaaren sammeln
+static void add_char_mistakes(const char *ref_word, const char *typed_word, Map *mchars) {
+        size_t i = 0;
+        size_t j = 0;
+        size_t rwlen = strlen(ref_word);
+        size_t twlen = strlen(typed_word);
+        while (i < rwlen && j < twlen) {
+            if (ref_word[i] == typed_word[j]) {
+                // Zeichen passt, weiter
+                i++;
+                j++;
+                continue;
+            }
+            //Fall 1: In typed_word ist ein Zeichen zu viel (Insertion), Beispiel: ref = "Haus", typed = "Haaus"
+            if (j + 1 < twlen && ref_word[i] == typed_word[j + 1]) {
+                // aktuelles typed-Zeichen ist "zu viel"
+                map_add_char(mchars, typed_word[j], 1);
+                j++; // typed aufholen
+                continue;
+            }
+            // Fall 2: In typed_word FEHLT ein Zeichen (Deletion), Beispiel: ref = "Haus", typed = "Hus"
+            if (i + 1 < rwlen && ref_word[i + 1] == typed_word[j]) {
+                // ref_word[i] wurde ausgelassen
+                map_add_char(mchars, ref_word[i], 1);
+                i++; // ref aufholen
+                continue;
+            }
+            // Fall 3: Substitution beides unterscheidet sich, aber kein klarer Insert/Delete
+            map_add_char(mchars, typed_word[j], 1);
+            i++;
+            j++;
+        }
+        // Restliche Zeichen in typed_word sind zu viel
+        while (j < twlen) {
+            map_add_char(mchars, typed_word[j], 1);
+            j++;
+        }
+}
+
+// ---------- Wortausrichtung (Myers O(ND)) ----------
+// Referenz- und getippte Wörter werden per Diff einander zugeordnet statt Wort k mit Wort k.
+// So verschiebt ein ausgelassenes oder doppelt getipptes Wort nicht alle folgenden Wörter.
+// Verglichen wird über Wort-Hashes, bei gleichem Hash bestätigt strcmp.
+// Laufzeit O((N+M)·D), Speicher O(D²) in der Arena, D = Zahl der Einfügungen + Löschungen.
+
+enum { ALIGN_MATCH, ALIGN_DELETE, ALIGN_INSERT };   // DELETE: Referenzwort fehlt, INSERT: Wort zu viel
+
+#define ALIGN_MAX_D 512    // mehr Unterschiede (ganz anderer Text): positionsweise vergleichen
+
+typedef struct {
+    char **words;
+    uint32_t *hash;
+    size_t n;
+} AlignSeq;
+
+static AlignSeq align_seq(Arena *a, char **words, size_t n) {
+    AlignSeq s;
+    size_t i;
+    s.words = words;
+    s.n = n;
+    s.hash = arena_alloc(a, (n + 1) * sizeof(uint32_t));
+    for (i = 0; i < n; i++) s.hash[i] = key_hash(words[i]);
+    return s;
+}
+
+static int align_eq(const AlignSeq *r, size_t i, const AlignSeq *t, size_t j) {
+    return r->hash[i] == t->hash[j] && strcmp(r->words[i], t->words[j]) == 0;
+}
+
+// Kürzeste Editfolge von r nach t in ops schreiben (Platz für r->n + t->n Einträge).
+// Rückgabe: Anzahl ops, -1 wenn mehr als ALIGN_MAX_D Unterschiede
+static long align_words(Arena *a, const AlignSeq *r, const AlignSeq *t, unsigned char *ops) {
+    long n = (long)r->n;
+    long m = (long)t->n;
+    long dmax = (n + m < ALIGN_MAX_D) ? n + m : ALIGN_MAX_D;
+    long off = dmax + 1;
+    long *v = arena_alloc(a, (size_t)(2 * dmax + 3) * sizeof(long));
+    long **trace = arena_alloc(a, (size_t)(dmax + 1) * sizeof(long *));
+    long d, k, x, y, nops = 0;
+
+    // Vorwärts: v[off+k] = weitestes x auf Diagonale k (k = x - y) mit d Unterschieden
+    v[off + 1] = 0;
+    for (d = 0; d <= dmax; d++) {
+        for (k = -d; k <= d; k += 2) {
+            if (k == -d || (k != d && v[off + k - 1] < v[off + k + 1])) {
+                x = v[off + k + 1];        // von oben: Wort in t eingefügt
+            } else {
+                x = v[off + k - 1] + 1;    // von links: Wort aus r gelöscht
+            }
+            y = x - k;
+            while (x < n && y < m && align_eq(r, (size_t)x, t, (size_t)y)) {
+                x++;
+                y++;
+            }
+            v[off + k] = x;
+            if (x >= n && y >= m) goto found;
+        }
+        // Diagonalen -d..d für das Zurückverfolgen sichern
+        trace[d] = arena_alloc(a, (size_t)(2 * d + 1) * sizeof(long));
+        memcpy(trace[d], v + off - d, (size_t)(2 * d + 1) * sizeof(long));
+    }
+    return -1;
+
+found:
+    // Rückwärts von (n, m): ops entstehen in umgekehrter Reihenfolge
+    x = n;
+    y = m;
+    for (; d > 0; d--) {
+        long *prev = trace[d - 1] + (d - 1);   // prev[k] für k in -(d-1)..d-1
+        long pk, px, py;
+        k = x - y;
+        if (k == -d || (k != d && prev[k - 1] < prev[k + 1])) {
+            pk = k + 1;
+        } else {
+            pk = k - 1;
+        }
+        px = prev[pk];
+        py = px - pk;
+        while (x > px && y > py) {
+            ops[nops++] = ALIGN_MATCH;
+            x--;
+            y--;
+        }
+        ops[nops++] = (pk == k + 1) ? ALIGN_INSERT : ALIGN_DELETE;
+        x = px;
+        y = py;
+    }
+    while (x > 0 && y > 0) {
+        ops[nops++] = ALIGN_MATCH;
+        x--;
+        y--;
+    }
+    for (k = 0; k < nops / 2; k++) {
+        unsigned char tmp = ops[k];
+        ops[k] = ops[nops - 1 - k];
+        ops[nops - 1 - k] = tmp;
+    }
+    return nops;
+}
+
+// Wortfehler für Referenzwort k zählen (über die vorab bestimmte Wortnummer wenn vorhanden) und in
+// res->wrong vermerken. wrong hat Platz für alle Wörter der Referenz, gleiche Wörter werden über
+// slot (Hash-Index in der Arena, Eintrag = Position in wrong + 1, höchstens halb voll) zusammengezählt.
+static void add_word_mistake(CompareResult *res, uint32_t *slot, size_t slot_cap, Map *mwords, const int32_t *ref_ids,
+                             const AlignSeq *rs, size_t k) {
+    const char *word = rs->words[k];
+    size_t s = rs->hash[k] & (slot_cap - 1);
+    if (ref_ids != NULL && ref_ids[k] >= 0 && mwords->pack == &lang) {
+        map_add_id(mwords, ref_ids[k], 1);
+    } else {
+        map_add(mwords, word, 1);
+    }
+    while (slot[s] != 0) {
+        KeyCount *w = &res->wrong[slot[s] - 1];
+        if (strcmp(w->key, word) == 0) {
+            w->count++;
+            return;
+        }
+        s = (s + 1) & (slot_cap - 1);
+    }
+    slot[s] = (uint32_t)res->n_wrong + 1;
+    res->wrong[res->n_wrong].key = (char *)word;
+    res->wrong[res->n_wrong].count = 1;
+    res->wrong[res->n_wrong].err = 0;
+    res->n_wrong++;
+}
+
+// Referenz- und eingegebenen Text vergleichen, mistake maps aktualisieren, Ergebnisse zurückgeben.
+// ref_ids: Wortnummern der Wörter in ref aus dem Sprachpaket (NULL wenn unbekannt, z.B. Textdateien).
+// Hilfsdaten und res.wrong liegen in der Arena a und bleiben bis zu deren Reset gültig.
+static CompareResult compare_texts(Arena *a, const char *ref, const int32_t *ref_ids, const char *typed, Map *mwords, Map *mchars) {
+    CompareResult res = {0, 0, 0, 0, NULL, 0, 0, 0, 0};
+    if (ref == NULL) ref = "";
+    if (typed == NULL) typed = "";
+    size_t rlen = strlen(ref);
+    size_t tlen = strlen(typed);
+    res.total_chars = rlen;
+    size_t minlen = (rlen < tlen) ? rlen : tlen;
+
+    // Vergleiche Zeichen
+    for (size_t i = 0; i < minlen; i++) {
+        if (typed[i] == ref[i]) {
+            res.correct_chars++;
+        }
+    }
+
+    // Wortvergleich (auf Kopien in der Arena, collect_words trennt die Wörter im Text auf)
+    char *ref_copy = arena_strdup(a, ref);
+    char *typed_copy = arena_strdup(a, typed);
+    char **ref_words;
+    char **typed_words;
+    size_t num_ref = collect_words(a, ref_copy, &ref_words);
+    size_t num_typed = collect_words(a, typed_copy, &typed_words);
+    res.wrong = arena_alloc(a, (num_ref + 1) * sizeof(KeyCount));
+    res.total_words = num_ref;
+    res.correct_words = 0;
+
+    AlignSeq rs = align_seq(a, ref_words, num_ref);
+    AlignSeq ts = align_seq(a, typed_words, num_typed);
+    size_t slot_cap = 16;
+    while (slot_cap < 2 * num_ref) slot_cap *= 2;
+    uint32_t *slot = arena_alloc(a, slot_cap * sizeof(uint32_t));
+    memset(slot, 0, slot_cap * sizeof(uint32_t));
+    unsigned char *ops = arena_alloc(a, num_ref + num_typed + 1);
+    long nops = align_words(a, &rs, &ts, ops);
+    if (nops < 0) {
+        // zu verschieden für die Ausrichtung: Wort k mit Wort k vergleichen
+        size_t min_num = (num_ref < num_typed) ? num_ref : num_typed;
+        for (size_t k = 0; k < min_num; k++) {
+            if (strcmp(ref_words[k], typed_words[k]) == 0) {
+                res.correct_words++;
+                char_models_word(ref_words[k], NULL);
+            } else {
+                res.substituted_words++;
+                add_word_mistake(&res, slot, slot_cap, mwords, ref_ids, &rs, k);
+                add_char_mistakes(ref_words[k], typed_words[k], mchars);
+                char_models_word(ref_words[k], typed_words[k]);
+            }
+        }
+        for (size_t k = min_num; k < num_ref; k++) {
+            res.deleted_words++;
+            add_word_mistake(&res, slot, slot_cap, mwords, ref_ids, &rs, k);
+        }
+        if (num_typed > num_ref) res.inserted_words = num_typed - num_ref;
+        return res;
+    }
+
+    // Editfolge abarbeiten. Gelöschte und eingefügte Wörter in einem Block zwischen zwei Treffern
+    // werden der Reihe nach als Ersetzungen gepaart, der Rest bleibt Auslassung bzw. Einfügung.
+    size_t i = 0, j = 0;
+    long p = 0;
+    while (p < nops) {
+        if (ops[p] == ALIGN_MATCH) {
+            res.correct_words++;
+            char_models_word(ref_words[i], NULL);
+            i++;
+            j++;
+            p++;
+            continue;
+        }
+        size_t del = 0, ins = 0;
+        while (p < nops && ops[p] != ALIGN_MATCH) {
+            if (ops[p] == ALIGN_DELETE) del++;
+            else ins++;
+            p++;
+        }
+        size_t pairs = (del < ins) ? del : ins;
+        for (size_t q = 0; q < del; q++) {
+            add_word_mistake(&res, slot, slot_cap, mwords, ref_ids, &rs, i + q);
+            if (q < pairs) {
+                add_char_mistakes(ref_words[i + q], typed_words[j + q], mchars);
+                char_models_word(ref_words[i + q], typed_words[j + q]);
+            }
+        }
+        res.substituted_words += pairs;
+        res.deleted_words += del - pairs;
+        res.inserted_words += ins - pairs;
+        i += del;
+        j += ins;
+    }
+    return res;
+}
+
+// Wie compare_texts, zusätzlich Anzahl und (mit --metrics) Latenz für die Metriken
+static CompareResult compare_and_update(Arena *a, const char *ref, const int32_t *ref_ids, const char *typed, Map *mwords, Map *mchars) {
+    uint64_t t0 = (metrics_path != NULL) ? metric_now_ns() : 0;
+    CompareResult res = compare_texts(a, ref, ref_ids, typed, mwords, mchars);
+    metric_inc(MC_ITEMS);
+    if (metrics_path != NULL) {
+        metric_observe(MH_SCORING, metric_now_ns() - t0);
+        metrics_tick();
+    }
+    return res;
+}
+
+// ---------- Tastaturlayout: Taste, Reihe, Finger und Hand pro Zeichen ----------
+// Jedes Layout beschreibt die vier Tastenreihen (ungeshiftet und geshiftet) und pro Taste den
+// Finger als Ziffer. Beim Start wird daraus pro Layout eine Tabelle über die Zeichen 0-255
+// (Latin-1, damit auch Umlaute) aufgebaut. Ein Layoutwechsel setzt nur den Zeiger key_pos um.
+// Beim Tippen werden pro Zeichen Anschläge, Fehler und Latenz gezählt (Index = Zeichen, O(1)),
+// die Zuordnung zu Finger/Reihe/Hand passiert erst in view_statistics mit dem aktuellen Layout.
+
+#define KEYSTATS_FILE "stats_keys.txt"
+#define LATENCY_MAX 2.0     // längere Pausen zählen nicht als Anschlagslatenz
+
+enum { FINGER_COUNT = 9, ROW_COUNT = 5, HAND_COUNT = 3 };
+
+static const char *finger_names[FINGER_COUNT] = {
+    "L pinky", "L ring", "L middle", "L index", "Thumbs", "R index", "R middle", "R ring", "R pinky"
+};
+static const char *row_names[ROW_COUNT] = { "Number", "Top", "Home", "Bottom", "Space" };
+static const char *hand_names[HAND_COUNT] = { "Left", "Right", "Both (space)" };
+
+typedef struct {
+    const char *name;
+    const char *rows[4];        // UTF-8
+    const char *shift_rows[4];  // UTF-8, gleiche Länge wie rows
+    const char *fingers[4];     // Finger pro Taste als Ziffer 0-8 (siehe finger_names)
+} Layout;
+
+static const Layout layouts[] = {
+    { "qwertz",
+      { "^1234567890ß´", "qwertzuiopü+", "asdfghjklöä#", "<yxcvbnm,.-" },
+      { "°!\"§$%&/()=?`", "QWERTZUIOPÜ*", "ASDFGHJKLÖÄ'", ">YXCVBNM;:_" },
+      { "0012335567888", "012335567888", "012335567888", "00123355678" } },
+    { "qwerty",
+      { "`1234567890-=", "qwertyuiop[]\\", "asdfghjkl;'", "zxcvbnm,./" },
+      { "~!@#$%^&*()_+", "QWERTYUIOP{}|", "ASDFGHJKL:\"", "ZXCVBNM<>?" },
+      { "0012335567888", "0123355678888", "01233556788", "0123355678" } },
+    { "dvorak",
+      { "`1234567890[]", "',.pyfgcrl/=\\", "aoeuidhtns-", ";qjkxbmwvz" },
+      { "~!@#$%^&*(){}", "\"<>PYFGCRL?+|", "AOEUIDHTNS_", ":QJKXBMWVZ" },
+      { "0012335567888", "0123355678888", "01233556788", "0123355678" } },
+};
+#define LAYOUT_COUNT (sizeof(layouts) / sizeof(layouts[0]))
+
+typedef struct {
+    signed char row;        // -1 = Zeichen liegt nicht auf dem Layout
+    signed char col;
+    signed char finger;
+    signed char hand;
+    signed char shift;      // nur mit Umschalttaste erreichbar
+} KeyPos;
+
+typedef struct {
+    long keys;              // Anschläge, bei denen dieses Zeichen erwartet wurde
+    long errors;            // davon falsch
+    double latency_sum;     // Sekunden seit dem vorherigen Anschlag
+    long latency_n;
+} KeyStat;
+
+static KeyPos layout_keys[LAYOUT_COUNT][256];
+static const KeyPos *key_pos = layout_keys[0];
+static size_t layout_current = 0;
+static KeyStat key_stats[256];
+
+// Tabellen aller Layouts aufbauen (einmal beim Start)
+static void layouts_init(void) {
+    size_t l;
+    for (l = 0; l < LAYOUT_COUNT; l++) {
+        const Layout *lay = &layouts[l];
+        KeyPos *tab = layout_keys[l];
+        int r;
+        int c;
+        for (c = 0; c < 256; c++) tab[c].row = -1;
+        for (r = 0; r < 4; r++) {
+            const char *p = lay->rows[r];
+            const char *q = lay->shift_rows[r];
+            for (c = 0; lay->fingers[r][c] != '\0'; c++) {
+                int f = lay->fingers[r][c] - '0';
+                int a = latin1_next(&p, strlen(p));
+                int b = latin1_next(&q, strlen(q));
+                KeyPos k;
+                k.row = (signed char)r;
+                k.col = (signed char)c;
+                k.finger = (signed char)f;
+                k.hand = (signed char)((f < 4) ? 0 : 1);
+                k.shift = 0;
+                if (a >= 0) tab[a] = k;
+                k.shift = 1;
+                if (b >= 0 && b != a) tab[b] = k;
+            }
+        }
+        tab[' '].row = 4;
+        tab[' '].col = 0;
+        tab[' '].finger = 4;
+        tab[' '].hand = 2;
+    }
+}
+
+// Layout per Name wählen, 0 wenn unbekannt
+static int layout_select(const char *name) {
+    size_t l;
+    for (l = 0; l < LAYOUT_COUNT; l++) {
+        if (strcmp(layouts[l].name, name) == 0) {
+            layout_current = l;
+            key_pos = layout_keys[l];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Anschlag für das erwartete Zeichen am Anfang von ref zählen (latency < 0: keine Messung).
+// Folgebytes von Mehrbyte-Zeichen werden nicht gezählt.
+static void key_stats_record(const char *ref, size_t avail, int ok, double latency) {
+    int ch = latin1_next(&ref, avail);
+    KeyStat *k;
+    if (ch < 0) return;
+    k = &key_stats[ch];
+    k->keys++;
+    if (!ok) k->errors++;
+    if (latency >= 0.0 && latency <= LATENCY_MAX) {
+        k->latency_sum += latency;
+        k->latency_n++;
+    }
+}
+
+static void key_stats_load(void) {
+    FILE *f = fopen(KEYSTATS_FILE, "r");
+    int ch;
+    KeyStat k;
+    if (f == NULL) return;
+    while (fscanf(f, "%d\t%ld\t%ld\t%lf\t%ld\n", &ch, &k.keys, &k.errors, &k.latency_sum, &k.latency_n) == 5) {
+        if (ch >= 0 && ch < 256) key_stats[ch] = k;
+    }
+    fclose(f);
+}
+
+static void key_stats_save(void) {
+    FILE *f = fopen(KEYSTATS_FILE, "w");
+    int ch;
+    if (f == NULL) {
+        perror("fopen keys");
+        return;
+    }
+    for (ch = 0; ch < 256; ch++) {
+        const KeyStat *k = &key_stats[ch];
+        if (k->keys == 0) continue;
+        fprintf(f, "%d\t%ld\t%ld\t%.6f\t%ld\n", ch, k->keys, k->errors, k->latency_sum, k->latency_n);
+    }
+    fclose(f);
+}
+
+// Eine Gruppe (Finger, Reihe oder Hand) der Auswertung
+typedef struct {
+    long keys;
+    long errors;
+    double latency_sum;
+    long latency_n;
+    long mistakes;          // Verwechslungen nach gewolltem Zeichen (auch Sessions ohne Live-Ansicht)
+} KeyGroup;
+
+static void key_group_print(const char *name, const KeyGroup *g) {
+    if (g->keys == 0 && g->mistakes == 0) return;
+    printf("  %-13s %8ld %7.2f%% %8.0f %9ld\n", name, g->keys,
+           g->keys ? 100.0 * (double)g->errors / (double)g->keys : 0.0,
+           g->latency_n ? 1000.0 * g->latency_sum / (double)g->latency_n : 0.0, g->mistakes);
+}
+
+// Verwechslungen dem gewollten Zeichen (want, Codepoint) zurechnen. mistakes_chars taugt dafür nicht,
+// dort steht das getippte Zeichen und der Fehler landete beim falschen Finger
+static void key_groups_add_mistakes(KeyGroup *fingers, KeyGroup *rows, KeyGroup *hands, KeyGroup *other,
+                                    int want, long n) {
+    const KeyPos *p;
+    if (want > 0xFF || key_pos[want].row < 0) {
+        other->mistakes += n;
+        return;
+    }
+    p = &key_pos[want];
+    fingers[(int)p->finger].mistakes += n;
+    rows[(int)p->row].mistakes += n;
+    hands[(int)p->hand].mistakes += n;
+}
+
+// Fehler und Latenz nach Finger, Reihe und Hand des aktuellen Layouts
+static void show_key_groups(void) {
+    KeyGroup fingers[FINGER_COUNT];
+    KeyGroup rows[ROW_COUNT];
+    KeyGroup hands[HAND_COUNT];
+    KeyGroup other;
+    size_t i;
+    int ch;
+
+    memset(fingers, 0, sizeof(fingers));
+    memset(rows, 0, sizeof(rows));
+    memset(hands, 0, sizeof(hands));
+    memset(&other, 0, sizeof(other));
+    for (ch = 0; ch < 256; ch++) {
+        const KeyStat *k = &key_stats[ch];
+        const KeyPos *p = &key_pos[ch];
+        KeyGroup *g[3];
+        int j;
+        if (k->keys == 0) continue;
+        if (p->row < 0) {
+            other.keys += k->keys;
+            other.errors += k->errors;
+            other.latency_sum += k->latency_sum;
+            other.latency_n += k->latency_n;
+            continue;
+        }
+        g[0] = &fingers[(int)p->finger];
+        g[1] = &rows[(int)p->row];
+        g[2] = &hands[(int)p->hand];
+        for (j = 0; j < 3; j++) {
+            g[j]->keys += k->keys;
+            g[j]->errors += k->errors;
+            g[j]->latency_sum += k->latency_sum;
+            g[j]->latency_n += k->latency_n;
+        }
+    }
+    for (i = 0; i < 128 * 128; i++) {
+        if (confusion_ascii[i] != 0) key_groups_add_mistakes(fingers, rows, hands, &other, (int)(i / 128), confusion_ascii[i]);
+    }
+    for (i = 0; i < confusion_wide_cap; i++) {
+        uint64_t k = confusion_wide[i].key;
+        if (k != 0) key_groups_add_mistakes(fingers, rows, hands, &other, (int)((k >> 21) & 0x1FFFFF), confusion_wide[i].count);
+    }
+
+    printf("\nKeys by finger, row and hand (layout %s):\n", layouts[layout_current].name);
+    printf("  %-13s %8s %8s %8s %9s\n", "", "keys", "errors", "ms/key", "mistakes");
+    printf(" by finger:\n");
+    for (i = 0; i < FINGER_COUNT; i++) key_group_print(finger_names[i], &fingers[i]);
+    printf(" by row:\n");
+    for (i = 0; i < ROW_COUNT; i++) key_group_print(row_names[i], &rows[i]);
+    printf(" by hand:\n");
+    for (i = 0; i < HAND_COUNT; i++) key_group_print(hand_names[i], &hands[i]);
+    key_group_print("not on layout", &other);
+}
+
+// ---------- Schwierigkeitsindex für Wörter und Sätze ----------
+// Jedes Item des Sprachpakets bekommt einmal eine Schwierigkeit aus Länge, seltenen Zeichen und
+// Zeichenpaaren (Häufigkeit im ganzen Paket), Umschalt-Zeichen des Layouts und Umlauten.
+// Pro Bank liegt ein nach Schwierigkeit sortierter Index vor, Stufe N (1..DIFF_LEVELS) ist das N-te
+// Zehntel davon: ein Item der Stufe zu ziehen kostet O(1). Der Index wird in DIFF_FILE ("%s" =
+// Sprache) zwischengespeichert und neu berechnet, wenn sich Texte, Layout oder Gewichte ändern.
+
+#define DIFF_FILE "difficulty_%s.idx"
+#define DIFF_MAGIC "TTDIFF\r\n"
+#define DIFF_VERSION 1
+#define DIFF_LEVELS 10
+#define DIFF_W_LEN 1.0      // pro Zeichen
+#define DIFF_W_CHAR 0.25    // pro Bit Seltenheit eines Zeichens
+#define DIFF_W_BIGRAM 0.25  // pro Bit Seltenheit eines Zeichenpaars
+#define DIFF_W_SHIFT 1.5    // pro Zeichen mit Umschalttaste
+#define DIFF_W_UMLAUT 2.0   // pro ä, ö, ü, ß
+
+typedef struct {
+    uint32_t *pos;          // Position in der Bank (lang.bank bzw. lang.sentences), aufsteigend nach score
+    float *score;
+    size_t n;
+} DiffIndex;
+
+static DiffIndex diff_words;
+static DiffIndex diff_sentences;
+static int diff_ready = 0;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_words;
+    uint32_t n_sentences;
+    uint32_t pad;
+    uint64_t key;           // Prüfsumme über Texte, Layout und Gewichte
+} DiffHeader;
+
+// log2 ohne libm (Ganzzahlteil durch Halbieren, Nachkommastellen durch Quadrieren)
+static double log2_approx(double x) {
+    double r = 0.0;
+    double bit = 0.5;
+    int i;
+    if (x <= 0.0) return 0.0;
+    while (x >= 2.0) {
+        x /= 2.0;
+        r += 1.0;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        r -= 1.0;
+    }
+    for (i = 0; i < 16; i++) {
+        x *= x;
+        if (x >= 2.0) {
+            x /= 2.0;
+            r += bit;
+        }
+        bit /= 2.0;
+    }
+    return r;
+}
+
+// Zeichen als Latin-1 (andere Bytes einzeln, damit nichts verloren geht)
+static int diff_next_char(const char **p, const char *end) {
+    int c = latin1_next(p, (size_t)(end - *p));
+    if (c < 0) c = (unsigned char)*(*p)++;
+    return c;
+}
+
+// Häufigkeiten von Zeichen und Zeichenpaaren im Text zählen
+static void diff_count(const char *text, uint32_t *chars, uint32_t *pairs) {
+    const char *p = text;
+    const char *end = text + strlen(text);
+    int prev = -1;
+    while (p < end) {
+        int c = diff_next_char(&p, end);
+        chars[c]++;
+        if (prev >= 0) pairs[prev * 256 + c]++;
+        prev = c;
+    }
+}
+
+static float diff_score(const char *text, const uint32_t *chars, const uint32_t *pairs,
+                        double total_chars, double total_pairs) {
+    const char *p = text;
+    const char *end = text + strlen(text);
+    int prev = -1;
+    double score = 0.0;
+    while (p < end) {
+        int c = diff_next_char(&p, end);
+        score += DIFF_W_LEN + DIFF_W_CHAR * log2_approx(total_chars / chars[c]);
+        if (prev >= 0) score += DIFF_W_BIGRAM * log2_approx(total_pairs / pairs[prev * 256 + c]);
+        if (key_pos[c].row >= 0 && key_pos[c].shift) score += DIFF_W_SHIFT;
+        if (c == 0xE4 || c == 0xF6 || c == 0xFC || c == 0xC4 || c == 0xD6 || c == 0xDC || c == 0xDF) {
+            score += DIFF_W_UMLAUT;
+        }
+        prev = c;
+    }
+    return (float)score;
+}
+
+static const float *diff_sort_scores;
+
+static int cmp_diff_pos(const void *a, const void *b) {
+    float x = diff_sort_scores[*(const uint32_t *)a];
+    float y = diff_sort_scores[*(const uint32_t *)b];
+    if (x < y) return -1;
+    if (x > y) return 1;
+    return (*(const uint32_t *)a < *(const uint32_t *)b) ? -1 : 1;
+}
+
+static void diff_alloc(DiffIndex *d, size_t n) {
+    d->n = n;
+    d->pos = malloc((n + 1) * sizeof(uint32_t));
+    d->score = malloc((n + 1) * sizeof(float));
+    if (d->pos == NULL || d->score == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+}
+
+// Index aus Scores pro Bankposition aufbauen (scores wird in sortierter Reihenfolge übernommen)
+static void diff_sort(DiffIndex *d, const float *scores) {
+    size_t i;
+    for (i = 0; i < d->n; i++) d->pos[i] = (uint32_t)i;
+    diff_sort_scores = scores;
+    qsort(d->pos, d->n, sizeof(uint32_t), cmp_diff_pos);
+    for (i = 0; i < d->n; i++) d->score[i] = scores[d->pos[i]];
+}
+
+// Prüfsumme über alles, wovon die Scores abhängen (FNV-1a 64)
+static uint64_t diff_key(void) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    char weights[128];
+    size_t i;
+    const char *parts[3];
+    snprintf(weights, sizeof(weights), "%d %g %g %g %g %g", DIFF_VERSION, DIFF_W_LEN, DIFF_W_CHAR,
+             DIFF_W_BIGRAM, DIFF_W_SHIFT, DIFF_W_UMLAUT);
+    parts[0] = weights;
+    parts[1] = layouts[layout_current].name;
+    parts[2] = lang.name;
+    for (i = 0; i < lang.bank_n + lang.sentence_n + 3; i++) {
+        const unsigned char *s;
+        if (i < 3) s = (const unsigned char *)parts[i];
+        else if (i < 3 + lang.bank_n) s = (const unsigned char *)lang.words[lang.bank[i - 3]];
+        else s = (const unsigned char *)lang.sentences[i - 3 - lang.bank_n].text;
+        for (; *s; s++) {
+            h ^= *s;
+            h *= 0x100000001B3ull;
+        }
+        h ^= 0xFF;   // Trenner zwischen den Texten
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+static int diff_load(const char *path, uint64_t key) {
+    FILE *f = fopen(path, "rb");
+    DiffHeader h;
+    int ok;
+    if (f == NULL) return 0;
+    ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, DIFF_MAGIC, 8) == 0 && h.version == DIFF_VERSION &&
+         h.key == key && h.n_words == lang.bank_n && h.n_sentences == lang.sentence_n;
+    if (ok) {
+        diff_alloc(&diff_words, h.n_words);
+        diff_alloc(&diff_sentences, h.n_sentences);
+        ok = fread(diff_words.pos, sizeof(uint32_t), diff_words.n, f) == diff_words.n &&
+             fread(diff_words.score, sizeof(float), diff_words.n, f) == diff_words.n &&
+             fread(diff_sentences.pos, sizeof(uint32_t), diff_sentences.n, f) == diff_sentences.n &&
+             fread(diff_sentences.score, sizeof(float), diff_sentences.n, f) == diff_sentences.n;
+        if (!ok) {
+            free(diff_words.pos);
+            free(diff_words.score);
+            free(diff_sentences.pos);
+            free(diff_sentences.score);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static void diff_save(const char *path, uint64_t key) {
+    char tmp_path[96];
+    DiffHeader h;
+    FILE *f;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    f = fopen(tmp_path, "wb");
+    if (f == NULL) return;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DIFF_MAGIC, 8);
+    h.version = DIFF_VERSION;
+    h.n_words = (uint32_t)diff_words.n;
+    h.n_sentences = (uint32_t)diff_sentences.n;
+    h.key = key;
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(diff_words.pos, sizeof(uint32_t), diff_words.n, f);
+    fwrite(diff_words.score, sizeof(float), diff_words.n, f);
+    fwrite(diff_sentences.pos, sizeof(uint32_t), diff_sentences.n, f);
+    fwrite(diff_sentences.score, sizeof(float), diff_sentences.n, f);
+    if (fclose(f) == 0) {
+        rename(tmp_path, path);
+    } else {
+        remove(tmp_path);
+    }
+}
+
+// Index laden oder (einmal) berechnen und speichern
+static void diff_ensure(void) {
+    char path[64];
+    uint64_t key;
+    uint32_t *chars;
+    uint32_t *pairs;
+    float *scores;
+    double total_chars = 0.0, total_pairs = 0.0;
+    size_t i;
+
+    if (diff_ready) return;
+    diff_ready = 1;
+    snprintf(path, sizeof(path), DIFF_FILE, lang.name);
+    key = diff_key();
+    if (diff_load(path, key)) return;
+
+    chars = calloc(256, sizeof(uint32_t));
+    pairs = calloc(256 * 256, sizeof(uint32_t));
+    scores = malloc((lang.bank_n + lang.sentence_n + 1) * sizeof(float));
+    if (chars == NULL || pairs == NULL || scores == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    for (i = 0; i < lang.bank_n; i++) diff_count(lang.words[lang.bank[i]], chars, pairs);
+    for (i = 0; i < lang.sentence_n; i++) diff_count(lang.sentences[i].text, chars, pairs);
+    for (i = 0; i < 256; i++) total_chars += chars[i];
+    for (i = 0; i < 256 * 256; i++) total_pairs += pairs[i];
+
+    diff_alloc(&diff_words, lang.bank_n);
+    for (i = 0; i < lang.bank_n; i++) {
+        scores[i] = diff_score(lang.words[lang.bank[i]], chars, pairs, total_chars, total_pairs);
+    }
+    diff_sort(&diff_words, scores);
+    diff_alloc(&diff_sentences, lang.sentence_n);
+    for (i = 0; i < lang.sentence_n; i++) {
+        scores[i] = diff_score(lang.sentences[i].text, chars, pairs, total_chars, total_pairs);
+    }
+    diff_sort(&diff_sentences, scores);
+    free(chars);
+    free(pairs);
+    free(scores);
+    diff_save(path, key);
+}
+
+// Bereich [*lo, *hi) der Stufe level im sortierten Index
+static void diff_band(const DiffIndex *d, int level, size_t *lo, size_t *hi) {
+    *lo = d->n * (size_t)(level - 1) / DIFF_LEVELS;
+    *hi = d->n * (size_t)level / DIFF_LEVELS;
+    if (*hi <= *lo && *lo < d->n) *hi = *lo + 1;   // sehr kleine Bänke: jede Stufe mindestens ein Item
+    if (*hi > d->n) {
+        *hi = d->n;
+        *lo = (d->n > 0) ? d->n - 1 : 0;
+    }
+}
+
+// Zufällige Bankposition der Stufe level (1..DIFF_LEVELS)
+static size_t diff_pick(const DiffIndex *d, int level) {
+    size_t lo, hi;
+    diff_band(d, level, &lo, &hi);
+    return d->pos[lo + (size_t)rand() % (hi - lo)];
+}
+
+// ---------- Auswertung pro Item ----------
+
+#define ROLLING_WINDOW 10   // Sekunden für die rollende WPM-Anzeige
+
+// WPM und Genauigkeit eines Items. Eine Formel für die Auswertung nach ENTER und die Live-Anzeige
+static void item_scores(size_t typed_len, size_t correct_chars, double secs, double *gross_wpm, double *accuracy) {
+    double minutes = secs / 60.0;
+    *gross_wpm = 0.0;
+    if (minutes > 0.0) {
+        *gross_wpm = ((double)typed_len / 5.0) / minutes; //double da Kommazahlen, /5 da Standardwert für ein Wort
+    }
+    if (typed_len > 0) {
+        *accuracy = ((double)correct_chars / (double)typed_len) * 100.0;
+    } else {
+        *accuracy = 0.0;
+    }
+}
+
+// Inkrementeller Zustand: wird pro Tastendruck in O(1) nachgeführt statt die ganze Zeile neu zu vergleichen.
+// correct_chars zählt wie compare_and_update positionsweise gleiche Bytes, daher stimmt das Endergebnis
+// mit der Auswertung nach ENTER überein.
+typedef struct {
+    const char *ref;
+    size_t rlen;
+    size_t typed_len;       // aktuell getippte Bytes
+    size_t correct_chars;   // davon an der richtigen Position korrekt
+    size_t error_keys;      // falsche Anschläge, auch wenn später korrigiert
+    size_t backspaces;
+    long bucket[ROLLING_WINDOW]; // getippte Bytes pro Sekunde (Ringpuffer)
+    long window_sum;
+    long bucket_sec;        // Sekunde des neuesten Buckets
+    double last_t;          // Zeit des vorherigen Anschlags, < 0 vor dem ersten
+} LiveScore;
+
+static void live_score_init(LiveScore *s, const char *ref) {
+    memset(s, 0, sizeof(*s));
+    s->ref = ref;
+    s->rlen = strlen(ref);
+    s->last_t = -1.0;
+}
+
+// Ringpuffer bis zur Sekunde t nachführen, abgelaufene Buckets fallen aus dem Fenster
+static void live_score_advance(LiveScore *s, double t) {
+    long sec = (long)t;
+    if (sec - s->bucket_sec >= ROLLING_WINDOW) {
+        memset(s->bucket, 0, sizeof(s->bucket));
+        s->window_sum = 0;
+        s->bucket_sec = sec;
+        return;
+    }
+    while (s->bucket_sec < sec) {
+        s->bucket_sec++;
+        s->window_sum -= s->bucket[s->bucket_sec % ROLLING_WINDOW];
+        s->bucket[s->bucket_sec % ROLLING_WINDOW] = 0;
+    }
+}
+
+// Ein Byte wurde angehängt (t = Sekunden seit Start des Items)
+static void live_score_key(LiveScore *s, unsigned char ch, double t) {
+    size_t p = s->typed_len;
+    int ok = p < s->rlen && (unsigned char)s->ref[p] == ch;
+    metric_inc(MC_KEYS);
+    live_score_advance(s, t);
+    if (ok) {
+        s->correct_chars++;
+    } else {
+        s->error_keys++;
+    }
+    if (p < s->rlen) {
+        key_stats_record(s->ref + p, s->rlen - p, ok, (s->last_t >= 0.0) ? t - s->last_t : -1.0);
+    }
+    s->last_t = t;
+    s->typed_len++;
+    s->bucket[s->bucket_sec % ROLLING_WINDOW]++;
+    s->window_sum++;
+}
+
+// Das letzte Byte (removed) wurde gelöscht
+static void live_score_backspace(LiveScore *s, unsigned char removed, double t) {
+    size_t p;
+    if (s->typed_len == 0) return;
+    p = s->typed_len - 1;
+    live_score_advance(s, t);
+    if (p < s->rlen && (unsigned char)s->ref[p] == removed) {
+        s->correct_chars--;
+    }
+    s->typed_len--;
+    s->backspaces++;
+    s->bucket[s->bucket_sec % ROLLING_WINDOW]--;
+    s->window_sum--;
+}
+
+// Netto-WPM: nicht korrigierte Fehler werden pro Minute abgezogen
+static double live_score_net_wpm(const LiveScore *s, double t) {
+    double minutes = t / 60.0;
+    double net;
+    if (minutes <= 0.0) return 0.0;
+    net = ((double)s->typed_len / 5.0 - (double)(s->typed_len - s->correct_chars)) / minutes;
+    return (net > 0.0) ? net : 0.0;
+}
+
+// WPM über die letzten ROLLING_WINDOW Sekunden (bzw. seit Start, falls kürzer)
+static double live_score_rolling_wpm(LiveScore *s, double t) {
+    double window;
+    live_score_advance(s, t);
+    window = (t < ROLLING_WINDOW) ? t : (double)ROLLING_WINDOW;
+    if (window <= 0.0 || s->window_sum <= 0) return 0.0;
+    return ((double)s->window_sum / 5.0) / (window / 60.0);
+}
+
+// Generiere eine Zufallszahl im Bereich [a, b]
+static int randint(int a, int b) {
+    return a + rand() % (b - a + 1); // +1 damit das obere Ende b inklusiv ist (Intervall [a,b] statt [a,b))
+}
+
+// Lese eine Zeile von stdin ein, beliebig lang (getline vergrössert den Puffer bei Bedarf)
+static char *read_line(void) {
+    char *line = NULL;
+    size_t cap = 0;
+
+    //Wenn getline -1 zurückgibt > keine Zeile gelesen (EOF)
+    if (getline(&line, &cap, stdin) < 0) {
+        free(line);
+        return NULL;
+    }
+    trim_newline(line);
+    //line ist Heap Speicher und bleibt gültig bis free verwendet wird
+    return line;
+}
+
+// Wiederverwendete Eingabepuffer, damit der Übungsloop nicht pro Zeile malloc/free braucht
+static char *tmp_line_buf = NULL;   // "Press ENTER" und ähnliche Zeilen
+static size_t tmp_line_cap = 0;
+static char *typed_buf = NULL;  // getippter Text (auch in der Live-Ansicht)
+static size_t typed_cap = 0;
+
+// Zeile in einen Puffer lesen, der nur bei Bedarf wächst, NULL bei EOF
+static char *read_line_into(char **buf, size_t *cap) {
+    if (getline(buf, cap, stdin) < 0) return NULL;
+    trim_newline(*buf);
+    return *buf;
+}
+
+// Zeile lesen, die nur bis zum nächsten Aufruf gebraucht wird (nicht freigeben)
+static char *read_line_tmp(void) {
+    return read_line_into(&tmp_line_buf, &tmp_line_cap);
+}
+
+// ---------- Tastenprotokoll: binäres Ereignis-Log pro Session ----------
+// Jede Session schreibt eine Datei in EVENTS_DIR mit allen Anschlägen, damit Zeitanalysen später
+// auf alten Daten wiederholt werden können. Aufbau:
+//   EVENTS_MAGIC (8 Bytes), varint Startzeit (ms seit 1970)
+//   Ereignisse: 1 Byte Aktion, bei EV_KEY/EV_BACKSPACE 1 Byte Taste, varint Abstand zum vorherigen
+//   Ereignis in ms, bei EV_ITEM_START zusätzlich varint Item-Nummer (Hash des Referenztexts).
+// Ein Anschlag braucht meist 3 Bytes. Geschrieben wird über einen eigenen Puffer, der am Ende jedes
+// Items geleert wird (bei einem Absturz fehlt höchstens das laufende Item).
+
+#define EVENTS_DIR "events"
+#define EVENTS_MAGIC "TTEV\r\n\x1a\n"
+#define EVENTS_BUF 65536
+
+enum { EV_KEY = 1, EV_BACKSPACE, EV_ITEM_START, EV_ITEM_END };
+
+typedef struct {
+    int fd;                 // -1 = keine Datei offen
+    unsigned char buf[EVENTS_BUF];
+    size_t len;
+    int64_t last_ms;
+} EventLog;
+
+static EventLog ev_log = { -1, {0}, 0, 0 };
+
+static int64_t now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static size_t varint_put(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+static void event_log_flush(EventLog *log) {
+    size_t off = 0;
+    while (off < log->len) {
+        ssize_t w = write(log->fd, log->buf + off, log->len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            perror("events");
+            break;
+        }
+        off += (size_t)w;
+    }
+    log->len = 0;
+}
+
+// Neue Datei events/YYYY-MM-DD_HHMMSS.ttev anlegen (mit Zähler, falls es sie schon gibt)
+static int event_log_open(EventLog *log, int64_t t_ms) {
+    char path[96];
+    char stamp[32];
+    time_t t = (time_t)(t_ms / 1000);
+    int i;
+    if (mkdir(EVENTS_DIR, 0755) != 0 && errno != EEXIST) return 0;
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d_%H%M%S", localtime(&t));
+    for (i = 0; i < 100; i++) {
+        if (i == 0) snprintf(path, sizeof(path), "%s/%s.ttev", EVENTS_DIR, stamp);
+        else snprintf(path, sizeof(path), "%s/%s-%d.ttev", EVENTS_DIR, stamp, i);
+        log->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+        if (log->fd >= 0) break;
+        if (errno != EEXIST) return 0;
+    }
+    if (log->fd < 0) return 0;
+    memcpy(log->buf, EVENTS_MAGIC, 8);
+    log->len = 8 + varint_put(log->buf + 8, (uint64_t)t_ms);
+    log->last_ms = t_ms;
+    return 1;
+}
+
+// Ereignis anhängen, die Datei wird beim ersten Ereignis der Session angelegt
+static void event_log_put(int action, unsigned char key, uint32_t item) {
+    EventLog *log = &ev_log;
+    int64_t t = now_ms();
+    int64_t dt;
+    if (log->fd < 0 && !event_log_open(log, t)) return;
+    if (log->len + 32 > EVENTS_BUF) event_log_flush(log);
+    dt = t - log->last_ms;
+    if (dt < 0) dt = 0;     // Uhr zurückgestellt
+    log->last_ms += dt;
+    log->buf[log->len++] = (unsigned char)action;
+    if (action == EV_KEY || action == EV_BACKSPACE) log->buf[log->len++] = key;
+    log->len += varint_put(log->buf + log->len, (uint64_t)dt);
+    if (action == EV_ITEM_START) log->len += varint_put(log->buf + log->len, item);
+    if (action == EV_ITEM_END) event_log_flush(log);
+}
+
+// Session beenden: Rest schreiben, nächste Session beginnt eine neue Datei
+static void event_log_close(void) {
+    if (ev_log.fd < 0) return;
+    event_log_flush(&ev_log);
+    close(ev_log.fd);
+    ev_log.fd = -1;
+}
+
+// Lesen in Blöcken, ohne die Datei ganz zu laden
+typedef struct {
+    int action;
+    unsigned char key;      // bei EV_KEY / EV_BACKSPACE
+    uint32_t item;          // Item, zu dem das Ereignis gehört
+    int64_t t_ms;           // absolute Zeit (ms seit 1970)
+} KeyEvent;
+
+typedef struct {
+    int fd;
+    unsigned char buf[EVENTS_BUF];
+    size_t pos;
+    size_t len;
+    int64_t t_ms;
+    uint32_t item;
+} EventReader;
+
+// Nächstes Byte, -1 am Dateiende
+static int event_reader_byte(EventReader *r) {
+    if (r->pos == r->len) {
+        ssize_t n;
+        do {
+            n = read(r->fd, r->buf, sizeof(r->buf));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) return -1;
+        r->pos = 0;
+        r->len = (size_t)n;
+    }
+    return r->buf[r->pos++];
+}
+
+static int event_reader_varint(EventReader *r, uint64_t *v) {
+    int shift = 0;
+    *v = 0;
+    while (shift < 64) {
+        int c = event_reader_byte(r);
+        if (c < 0) return 0;
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return 1;
+        shift += 7;
+    }
+    return 0;
+}
+
+// Rückgabe 0 wenn die Datei fehlt oder kein Tastenprotokoll ist
+static int event_reader_open(EventReader *r, const char *path) {
+    unsigned char magic[8];
+    uint64_t start;
+    int i;
+    r->pos = r->len = 0;
+    r->item = 0;
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) return 0;
+    for (i = 0; i < 8; i++) {
+        int c = event_reader_byte(r);
+        if (c < 0) break;
+        magic[i] = (unsigned char)c;
+    }
+    if (i < 8 || memcmp(magic, EVENTS_MAGIC, 8) != 0 || !event_reader_varint(r, &start)) {
+        close(r->fd);
+        return 0;
+    }
+    r->t_ms = (int64_t)start;
+    return 1;
+}
+
+// Nächstes Ereignis: 1 = gelesen, 0 = Ende, -1 = beschädigt oder abgeschnitten
+static int event_next(EventReader *r, KeyEvent *ev) {
+    uint64_t v;
+    int c = event_reader_byte(r);
+    if (c < 0) return 0;
+    if (c < EV_KEY || c > EV_ITEM_END) return -1;
+    ev->action = c;
+    ev->key = 0;
+    if (c == EV_KEY || c == EV_BACKSPACE) {
+        int k = event_reader_byte(r);
+        if (k < 0) return -1;
+        ev->key = (unsigned char)k;
+    }
+    if (!event_reader_varint(r, &v)) return -1;
+    r->t_ms += (int64_t)v;
+    if (c == EV_ITEM_START) {
+        if (!event_reader_varint(r, &v)) return -1;
+        r->item = (uint32_t)v;
+    }
+    ev->item = r->item;
+    ev->t_ms = r->t_ms;
+    return 1;
+}
+
+static void event_reader_close(EventReader *r) {
+    close(r->fd);
+}
+
+// --events FILE...: Zusammenfassung pro Datei aus dem Protokoll neu berechnen
+// (Median des Anschlagabstands über ein Histogramm in ms, Abstände über 2 s zählen als Pause)
+static int events_report(char **paths, int n) {
+    int i, rc = 0;
+    printf("%-32s %6s %8s %6s %9s %8s %10s\n", "File", "Items", "Keys", "Back", "Typing s", "WPM", "Median ms");
+    for (i = 0; i < n; i++) {
+        static long hist[2001];
+        EventReader r;
+        KeyEvent ev;
+        long items = 0, keys = 0, backs = 0, gaps = 0, half, acc = 0;
+        int64_t item_start = -1, last_key = -1, typing_ms = 0;
+        int got, median = 0;
+
+        if (!event_reader_open(&r, paths[i])) {
+            printf("%-32s not a keystroke log\n", paths[i]);
+            rc = 1;
+            continue;
+        }
+        memset(hist, 0, sizeof(hist));
+        while ((got = event_next(&r, &ev)) == 1) {
+            if (ev.action == EV_ITEM_START) {
+                items++;
+                item_start = ev.t_ms;
+                last_key = -1;
+            } else if (ev.action == EV_ITEM_END) {
+                if (item_start >= 0) typing_ms += ev.t_ms - item_start;
+                item_start = -1;
+            } else {
+                if (ev.action == EV_KEY) keys++;
+                else backs++;
+                if (last_key >= 0 && ev.t_ms - last_key <= 2000) {
+                    hist[ev.t_ms - last_key]++;
+                    gaps++;
+                }
+                last_key = ev.t_ms;
+            }
+        }
+        event_reader_close(&r);
+        if (got < 0) printf("%s: truncated, reporting events up to the damage\n", paths[i]);
+        half = (gaps + 1) / 2;
+        for (median = 0; median <= 2000 && gaps > 0; median++) {
+            acc += hist[median];
+            if (acc >= half) break;
+        }
+        printf("%-32s %6ld %8ld %6ld %9.1f %8.2f %10d\n", paths[i], items, keys, backs, typing_ms / 1000.0,
+               typing_ms > 0 ? (keys / 5.0) / (typing_ms / 60000.0) : 0.0, gaps > 0 ? median : 0);
+    }
+    return rc;
+}
+
+// ---------- Live-Ansicht: Anzeige während dem Tippen ----------
+// Das Terminal wird in den Raw-Modus geschaltet, jeder Tastendruck wird sofort verarbeitet.
+// Ein Frame wird zuerst in einen Zellenpuffer (back) gezeichnet und mit dem zuletzt
+// ausgegebenen Frame (front) verglichen. Nur geänderte Zellen werden ausgegeben,
+// gesammelt in einem Puffer und mit einem einzigen write() geschrieben (wichtig über SSH).
+
+static int live_view = 0;              // wird in main gesetzt, wenn stdin und stdout ein Terminal sind
+static struct termios saved_termios;   // Terminal-Einstellungen vor dem Raw-Modus
+static volatile sig_atomic_t raw_active = 0;
+
+// Darstellungsattribute einer Zelle
+enum {
+    ATTR_PLAIN = 0,
+    ATTR_PENDING,  // Referenz, noch nicht getippt
+    ATTR_CURRENT,  // nächstes zu tippendes Zeichen
+    ATTR_OK,       // korrekt getippt
+    ATTR_BAD,      // falsch getippt
+    ATTR_BOLD
+};
+
+// SGR Escape-Sequenzen passend zu den Attributen oben
+static const char *attr_sgr[] = {
+    "\x1b[0m", "\x1b[0;2m", "\x1b[0;7m", "\x1b[0;32m", "\x1b[0;1;31m", "\x1b[0;1m"
+};
+
+typedef struct {
+    char glyph[4];      // UTF-8 Bytes eines Zeichens
+    unsigned char len;  // 0 = leere Zelle
+    unsigned char attr;
+} Cell;
+
+typedef struct {
+    int rows;
+    int cols;
+    Cell *front;        // Stand auf dem Terminal
+    Cell *back;         // neuer Frame
+    int front_valid;    // 0 = alles neu zeichnen
+    char *out;          // Ausgabepuffer für einen Frame
+    size_t out_len;
+    size_t out_cap;
+    int cursor_row;     // Cursor nach dem Frame (0-basiert)
+    int cursor_col;
+    int used_rows;      // Anzahl Zeilen, die der Frame belegt
+} Screen;
+
+// Terminal zurück in den normalen Modus (auch aus Signal-Handlern aufrufbar)
+static void term_restore(void) {
+    if (raw_active) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+        raw_active = 0;
+    }
+}
+
+static void term_signal(int sig) {
+    term_restore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Raw-Modus: keine Zeilenpufferung, kein Echo. Ctrl-C (ISIG) bleibt aktiv.
+static int term_raw(void) {
+    struct termios t;
+    if (tcgetattr(STDIN_FILENO, &saved_termios) != 0) return -1;
+    t = saved_termios;
+    t.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    t.c_iflag &= ~(IXON | ICRNL);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &t) != 0) return -1;
+    raw_active = 1;
+    return 0;
+}
+
+// Länge einer UTF-8 Sequenz anhand des ersten Bytes (ungültige Bytes zählen als 1)
+static size_t utf8_len(unsigned char c) {
+    if (c < 0x80) return 1;
+    if ((c & 0xE0) == 0xC0) return 2;
+    if ((c & 0xF0) == 0xE0) return 3;
+    if ((c & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+// Startoffsets aller Zeichen (Codepoints) in s berechnen, starts[n] = strlen(s)
+static size_t utf8_starts(const char *s, size_t len, size_t **starts, size_t *cap) {
+    size_t n = 0;
+    size_t i = 0;
+    while (1) {
+        if (n + 1 >= *cap) {
+            size_t newcap = (*cap == 0) ? 64 : *cap * 2;
+            size_t *tmp = realloc(*starts, newcap * sizeof(size_t));
+            if (tmp == NULL) {
+                printf("Fehler bei realloc\n");
+                exit(1);
+            }
+            *starts = tmp;
+            *cap = newcap;
+        }
+        if (i >= len) break;
+        (*starts)[n++] = i;
+        i += utf8_len((unsigned char)s[i]);
+        if (i > len) i = len;
+    }
+    (*starts)[n] = len;
+    return n;
+}
+
+static void out_append(Screen *scr, const char *data, size_t len) {
+    if (scr->out_len + len > scr->out_cap) {
+        size_t newcap = (scr->out_cap == 0) ? 4096 : scr->out_cap;
+        while (newcap < scr->out_len + len) newcap *= 2;
+        char *tmp = realloc(scr->out, newcap);
+        if (tmp == NULL) {
+            printf("Fehler bei realloc\n");
+            exit(1);
+        }
+        scr->out = tmp;
+        scr->out_cap = newcap;
+    }
+    memcpy(scr->out + scr->out_len, data, len);
+    scr->out_len += len;
+}
+
+// Terminalgrösse abfragen, bei Änderung Puffer neu anlegen und alles neu zeichnen
+static void screen_fit(Screen *scr) {
+    struct winsize ws;
+    int rows = 24;
+    int cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+    if (rows == scr->rows && cols == scr->cols && scr->back != NULL) return;
+    free(scr->front);
+    free(scr->back);
+    scr->rows = rows;
+    scr->cols = cols;
+    scr->front = calloc((size_t)rows * cols, sizeof(Cell));
+    scr->back = calloc((size_t)rows * cols, sizeof(Cell));
+    if (scr->front == NULL || scr->back == NULL) {
+        printf("Fehler bei calloc\n");
+        exit(1);
+    }
+    scr->front_valid = 0;
+}
+
+static void screen_put(Screen *scr, int row, int col, const char *glyph, size_t len, unsigned char attr) {
+    Cell *c;
+    if (row < 0 || row >= scr->rows || col < 0 || col >= scr->cols - 1) return; // letzte Spalte frei lassen (Autowrap)
+    c = &scr->back[(size_t)row * scr->cols + col];
+    if (len > sizeof(c->glyph)) len = sizeof(c->glyph);
+    memcpy(c->glyph, glyph, len);
+    c->len = (unsigned char)len;
+    c->attr = attr;
+}
+
+static void screen_puts(Screen *scr, int row, int col, const char *s, unsigned char attr) {
+    size_t i = 0;
+    size_t len = strlen(s);
+    while (i < len) {
+        size_t l = utf8_len((unsigned char)s[i]);
+        if (i + l > len) l = len - i;
+        screen_put(scr, row, col++, s + i, l, attr);
+        i += l;
+    }
+}
+
+// Nur die geänderten Zellen ausgeben, alles in einem write()
+static void screen_flush(Screen *scr) {
+    char esc[32];
+    int pen_row = -1;
+    int pen_col = -1;
+    int pen_attr = -1;
+    size_t off = 0;
+    int r, c;
+
+    scr->out_len = 0;
+    if (!scr->front_valid) {
+        out_append(scr, "\x1b[0m\x1b[H\x1b[2J", 11);
+        pen_attr = ATTR_PLAIN;
+        memset(scr->front, 0, (size_t)scr->rows * scr->cols * sizeof(Cell));
+    }
+    for (r = 0; r < scr->rows; r++) {
+        for (c = 0; c < scr->cols; c++) {
+            size_t idx = (size_t)r * scr->cols + c;
+            Cell *b = &scr->back[idx];
+            Cell *f = &scr->front[idx];
+            if (b->len == f->len && b->attr == f->attr && memcmp(b->glyph, f->glyph, b->len) == 0) continue;
+            if (r != pen_row || c != pen_col) {
+                int l = snprintf(esc, sizeof(esc), "\x1b[%d;%dH", r + 1, c + 1);
+                out_append(scr, esc, (size_t)l);
+            }
+            if (b->attr != pen_attr) {
+                out_append(scr, attr_sgr[b->attr], strlen(attr_sgr[b->attr]));
+                pen_attr = b->attr;
+            }
+            if (b->len > 0) out_append(scr, b->glyph, b->len);
+            else out_append(scr, " ", 1);
+            pen_row = r;
+            pen_col = c + 1;
+            *f = *b;
+        }
+    }
+    {
+        int l = snprintf(esc, sizeof(esc), "\x1b[0m\x1b[%d;%dH", scr->cursor_row + 1, scr->cursor_col + 1);
+        out_append(scr, esc, (size_t)l);
+    }
+    scr->front_valid = 1;
+
+    while (off < scr->out_len) {
+        ssize_t w = write(STDOUT_FILENO, scr->out + off, scr->out_len - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += (size_t)w;
+    }
+}
+
+// Zeilenumbruch der Referenz an Wortgrenzen, gibt Anzahl Segmente zurück (seg[k] = erster Codepoint)
+static size_t live_wrap(const char *ref, const size_t *rstart, size_t rn, int width, size_t **seg, size_t *segcap) {
+    size_t n = 0;
+    size_t s = 0;
+    if (width < 1) width = 1;
+    do {
+        size_t e;
+        if (n + 2 > *segcap) {
+            size_t newcap = (*segcap == 0) ? 16 : *segcap * 2;
+            size_t *tmp = realloc(*seg, newcap * sizeof(size_t));
+            if (tmp == NULL) {
+                printf("Fehler bei realloc\n");
+                exit(1);
+            }
+            *seg = tmp;
+            *segcap = newcap;
+        }
+        (*seg)[n++] = s;
+        if (rn - s <= (size_t)width) break;
+        e = s + (size_t)width;
+        // letztes Leerzeichen im Segment suchen, sonst hart umbrechen
+        while (e > s && ref[rstart[e - 1]] != ' ') e--;
+        if (e == s) e = s + (size_t)width;
+        s = e;
+    } while (s < rn);
+    (*seg)[n] = rn;
+    return n;
+}
+
+// Einen Frame zeichnen: Kopfzeile, Referenz mit getipptem Text darunter, Statuszeile
+static void live_render(Screen *scr, const char *header, const char *ref, const size_t *rstart, size_t rn,
+                        const char *typed, const size_t *tstart, size_t tn, const char *status,
+                        size_t **seg, size_t *segcap) {
+    size_t nseg;
+    size_t cur_seg = 0;
+    size_t first_seg = 0;
+    size_t visible;
+    size_t k;
+    int row;
+
+    screen_fit(scr);
+    memset(scr->back, 0, (size_t)scr->rows * scr->cols * sizeof(Cell));
+    screen_puts(scr, 0, 0, header, ATTR_BOLD);
+
+    nseg = live_wrap(ref, rstart, rn, scr->cols - 1, seg, segcap);
+    while (cur_seg + 1 < nseg && (*seg)[cur_seg + 1] <= tn) cur_seg++;
+    visible = (scr->rows > 6) ? (size_t)(scr->rows - 4) / 2 : 1;
+    if (cur_seg + 1 > visible) first_seg = cur_seg + 1 - visible;
+
+    row = 2;
+    scr->cursor_row = 3;
+    scr->cursor_col = 0;
+    for (k = first_seg; k < nseg && k < first_seg + visible; k++) {
+        size_t from = (*seg)[k];
+        size_t to = (k + 1 == nseg) ? ((tn > rn) ? tn : rn) : (*seg)[k + 1];
+        size_t i;
+        for (i = from; i < to; i++) {
+            int col = (int)(i - from);
+            int have_ref = i < rn;
+            int have_typed = i < tn;
+            int match = 0;
+            if (have_ref && have_typed) {
+                size_t rl = rstart[i + 1] - rstart[i];
+                size_t tl = tstart[i + 1] - tstart[i];
+                match = (rl == tl && memcmp(ref + rstart[i], typed + tstart[i], rl) == 0);
+            }
+            if (have_ref) {
+                unsigned char a = ATTR_PENDING;
+                if (have_typed) a = match ? ATTR_OK : ATTR_BAD;
+                else if (i == tn) a = ATTR_CURRENT;
+                screen_put(scr, row, col, ref + rstart[i], rstart[i + 1] - rstart[i], a);
+            }
+            if (have_typed) {
+                const char *g = typed + tstart[i];
+                size_t gl = tstart[i + 1] - tstart[i];
+                if (!match && gl == 1 && *g == ' ') {
+                    g = "_"; // falsches Leerzeichen sichtbar machen
+                }
+                screen_put(scr, row + 1, col, g, gl, match ? ATTR_OK : ATTR_BAD);
+            }
+        }
+        if (k == cur_seg) {
+            scr->cursor_row = row + 1;
+            scr->cursor_col = (int)(tn - from);
+            if (scr->cursor_col > scr->cols - 2) scr->cursor_col = scr->cols - 2;
+        }
+        row += 2;
+    }
+    screen_puts(scr, row + 1, 0, status, ATTR_PLAIN);
+    scr->used_rows = row + 2;
+    screen_flush(scr);
+}
+
+// Puffer der Live-Ansicht, bleiben über Items hinweg erhalten und wachsen nur bei Bedarf
+static Screen live_scr;
+static size_t *live_rstart = NULL;
+static size_t live_rcap = 0;
+static size_t *live_tstart = NULL;
+static size_t live_tcap = 0;
+static size_t *live_seg = NULL;
+static size_t live_segcap = 0;
+
+// Zeitlimit für Tests auf Zeit (siehe timed_practice). fd ist ein periodischer timerfd mit 1 s Takt,
+// die Eingabe wartet per poll auf Taste oder Takt: kein busy waiting, genau zum Ablauf wird gestoppt
+typedef struct {
+    int fd;                 // -1 = kein Zeitlimit
+    long left;              // verbleibende Sekunden (Takte bis zum Ablauf)
+} TimedTest;
+
+static TimedTest timed = { -1, 0 };
+
+// Abgelaufene Takte abholen (nicht blockierend), Rückgabe 1 wenn die Zeit um ist
+static int timed_expired(void) {
+    uint64_t exp;
+    if (timed.fd < 0) return 0;
+    if (read(timed.fd, &exp, sizeof(exp)) == (ssize_t)sizeof(exp)) timed.left -= (long)exp;
+    return timed.left <= 0;
+}
+
+// Auf eine Taste oder den nächsten Takt warten.
+// Rückgabe 1: Eingabe bereit, 0: Takt (Anzeige aktualisieren), -1: Zeit abgelaufen
+static int timed_wait(void) {
+    struct pollfd p[2];
+    p[0].fd = STDIN_FILENO;
+    p[0].events = POLLIN;
+    p[1].fd = timed.fd;
+    p[1].events = POLLIN;
+    while (1) {
+        int r = poll(p, 2, -1);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        if (p[1].revents & POLLIN) {
+            if (timed_expired()) return -1;
+            if (!(p[0].revents & POLLIN)) return 0;
+        }
+        if (p[0].revents & (POLLIN | POLLHUP | POLLERR)) return 1;
+    }
+}
+
+// Eine Eingabe mit Live-Ansicht lesen. Rückgabe in typed_buf (nicht freigeben), NULL bei EOF.
+// Bei einem Test auf Zeit endet die Eingabe beim Ablauf, zurück kommt der bis dahin getippte Teil
+static char *read_line_live(const char *header, const char *ref) {
+    Screen *scr = &live_scr;
+    char *typed;
+    size_t len = 0;
+    size_t rn, tn;
+    int esc_state = 0; // 0 = normal, 1 = nach ESC, 2 = in CSI-Sequenz
+    int eof = 0;
+    int dirty = 1;     // nur neu zeichnen, wenn sich etwas geändert hat
+    size_t pending = 0; // fehlende Folgebytes eines UTF-8 Zeichens
+    char status[160];
+    LiveScore score;
+    struct timeval start, now;
+
+    if (term_raw() != 0) {
+        // ohne Raw-Modus nur zeilenweise; ein Test auf Zeit könnte so nicht beim Ablauf stoppen
+        if (timed.fd >= 0) return NULL;
+        return read_line_into(&typed_buf, &typed_cap);
+    }
+    live_score_init(&score, ref);
+    gettimeofday(&start, NULL);
+    scr->front_valid = 0; // neues Item: ganzen Bildschirm zeichnen
+
+    rn = utf8_starts(ref, strlen(ref), &live_rstart, &live_rcap);
+    tn = 0;
+    if (typed_cap < 64) {
+        char *tmp = realloc(typed_buf, 64);
+        if (tmp == NULL) {
+            printf("Fehler bei realloc\n");
+            exit(1);
+        }
+        typed_buf = tmp;
+        typed_cap = 64;
+    }
+    typed = typed_buf;
+    typed[0] = '\0';
+
+    while (1) {
+        unsigned char ch;
+        ssize_t r;
+
+        if (dirty) {
+            double t, wpm, acc;
+            size_t sl;
+            gettimeofday(&now, NULL);
+            t = elapsed_seconds(start, now);
+            item_scores(score.typed_len, score.correct_chars, t, &wpm, &acc);
+            tn = utf8_starts(typed, len, &live_tstart, &live_tcap);
+            // beim Test auf Zeit steht die Restzeit vorne, damit sie auch in schmalen Terminals sichtbar ist
+            sl = (timed.fd >= 0) ? (size_t)snprintf(status, sizeof(status), "Time left %lds   ", timed.left) : 0;
+            snprintf(status + sl, sizeof(status) - sl, "WPM %5.1f  net %5.1f  last %ds %5.1f   Accuracy %5.1f%%   Errors %3zu   Chars %zu/%zu",
+                     wpm, live_score_net_wpm(&score, t), ROLLING_WINDOW, live_score_rolling_wpm(&score, t),
+                     acc, score.typed_len - score.correct_chars, tn, rn);
+
+            live_render(scr, header, ref, live_rstart, rn, typed, live_tstart, tn, status, &live_seg, &live_segcap);
+            dirty = 0;
+        }
+
+        if (timed.fd >= 0) {
+            int w = timed_wait();
+            if (w < 0) break;
+            if (w == 0) {
+                dirty = 1;
+                continue;
+            }
+        }
+        r = read(STDIN_FILENO, &ch, 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            eof = 1;
+            break;
+        }
+        if (esc_state == 1) {
+            esc_state = (ch == '[' || ch == 'O') ? 2 : 0;
+            if (esc_state == 2) continue;
+        } else if (esc_state == 2) {
+            if (ch >= 0x40 && ch <= 0x7E) esc_state = 0; // Ende der Steuersequenz (Pfeiltasten usw.)
+            continue;
+        }
+        if (ch == 0x1b) {
+            esc_state = 1;
+            continue;
+        }
+        if (ch == '\r' || ch == '\n') break;
+        if (ch == 4 && len == 0) { // Ctrl-D auf leerer Eingabe
+            eof = 1;
+            break;
+        }
+        if (ch == 127 || ch == 8) {
+            // ganzes UTF-8 Zeichen entfernen
+            tn = utf8_starts(typed, len, &live_tstart, &live_tcap);
+            if (tn > 0) {
+                gettimeofday(&now, NULL);
+                while (len > live_tstart[tn - 1]) {
+                    len--;
+                    live_score_backspace(&score, (unsigned char)typed[len], elapsed_seconds(start, now));
+                    event_log_put(EV_BACKSPACE, (unsigned char)typed[len], 0);
+                }
+                typed[len] = '\0';
+                dirty = 1;
+            }
+            pending = 0;
+            continue;
+        }
+        if (ch < 0x20) continue; // andere Steuerzeichen ignorieren
+        if (len + 2 > typed_cap) {
+            char *tmp = realloc(typed_buf, typed_cap * 2);
+            if (tmp == NULL) {
+                printf("Fehler bei realloc\n");
+                exit(1);
+            }
+            typed_buf = typed = tmp;
+            typed_cap *= 2;
+        }
+        gettimeofday(&now, NULL);
+        live_score_key(&score, ch, elapsed_seconds(start, now));
+        event_log_put(EV_KEY, ch, 0);
+        typed[len++] = (char)ch;
+        typed[len] = '\0';
+        // unvollständige UTF-8 Zeichen erst zeichnen, wenn alle Bytes da sind
+        if (pending > 0 && (ch & 0xC0) == 0x80) pending--;
+        else pending = utf8_len(ch) - 1;
+        if (pending == 0) dirty = 1;
+    }
+
+    // Cursor unter den Frame setzen, danach geht die normale Ausgabe weiter
+    {
+        char esc[32];
+        int l = snprintf(esc, sizeof(esc), "\x1b[0m\x1b[%d;1H\n", scr->used_rows);
+        scr->out_len = 0;
+        out_append(scr, esc, (size_t)l);
+        if (write(STDOUT_FILENO, scr->out, scr->out_len) < 0) {
+            // Ausgabe nicht möglich, Eingabe trotzdem zurückgeben
+        }
+    }
+    term_restore();
+    if (eof && len == 0) return NULL;
+    return typed;
+}
+
+// Getippten Text zu einer Referenz lesen, je nach Einstellung mit Live-Ansicht.
+// Rückgabe liegt in typed_buf und bleibt bis zum nächsten Aufruf gültig (nicht freigeben)
+// Start und Ende werden ins Tastenprotokoll geschrieben, Anschläge nur in der Live-Ansicht
+static char *read_typed(const char *header, const char *ref) {
+    char *typed;
+    event_log_put(EV_ITEM_START, 0, key_hash(ref));
+    if (live_view) {
+        fflush(stdout);
+        typed = read_line_live(header, ref);
+    } else {
+        typed = read_line_into(&typed_buf, &typed_cap);
+    }
+    event_log_put(EV_ITEM_END, 0, 0);
+    return typed;
+}
+
+// Einträge absteigend sortieren (in place) und die ersten n ausgeben
+// m: Map, aus der die Einträge stammen (für die Anzeige verfallener Zähler), NULL bei einfachen Listen
+static void show_top_items(KeyCount *items, size_t count, int n, const Map *m) {
+    size_t i;
+    int limit;
+    char num[32];
+
+    qsort(items, count, sizeof(KeyCount), cmp_kc_desc); //generisches Sortieren per Compare-Funktion (Array-Pointer, Anzahl Elemente, Grösse eine Elements, Vergleichsfunktion)
+
+    //Wenn n grösser als das eigentliche Array ist
+    if (n < (int)count) {
+        limit = n;
+    } else {
+        limit = (int)count;
+    }
+
+    for (i = 0; i < (size_t)limit; i++) {
+        //%d = int, %-12s = mind. Länge von 12 Zeichen daher alle ":" untereinander, %ld  = Long Count Wert
+        printf("  %d) %-12s : %s", (int)i + 1, items[i].key, map_count_text(m, items[i].count, num, sizeof(num)));
+        if (items[i].err > 0) printf("  (at most %s too high)", map_count_text(m, items[i].err, num, sizeof(num)));
+        printf("\n");
+    }
+}
+
+// Zeige die Top N Einträge aus der Map, sortiert nach Anzahl
+static void show_top_map(Map *m, int n) {
+    size_t i;
+    KeyCount *copy;
+
+    if (m->n == 0) {
+        printf("  (none)\n");
+        return;
+    }
+    //Originaldaten der Map nicht verändern > Deshalb eine Kopie
+    copy = malloc(m->n * sizeof(KeyCount));
+    if (copy == NULL) {
+        printf("Fehler bei malloc\n");
+        return;
+    }
+
+    for (i = 0; i < m->n; i++) {
+        copy[i] = m->items[i];
+    }
+    show_top_items(copy, m->n, n, m);
+    free(copy);
+}
+
+// Zeige Gesamtstatistiken und Top-Fehler an
+static void view_statistics(Map *mwords, Map *mchars) {
+    double avg_wpm, best_wpm, avg_acc;
+    size_t sessions;
+
+    compute_aggregate_stats(&avg_wpm, &best_wpm, &avg_acc, &sessions);
+
+    printf("\n=== Statistics ===\n");
+    printf("Sessions recorded: %zu\n", sessions); //%zu Format Specifier für size_t
+    if (sessions > 0) {
+        printf("Average WPM: %.2f\n", avg_wpm);
+        printf("Best WPM   : %.2f\n", best_wpm);
+        printf("Average Accuracy: %.2f%%\n", avg_acc);
+    }
+    board_show_self();
+    {
+        // Perzentile aus den Sketches, gesamt und pro Modus
+        SketchSet set = {NULL, 0};
+        size_t i;
+        sketches_load(&set, SKETCH_FILE);
+        if (set.n > 0) {
+            printf("\nPercentiles              median        p90        p99  (sessions)\n");
+        }
+        for (i = 0; i < set.n; i++) {
+            const Kll *s = &set.items[i];
+            int is_wpm = strncmp(s->name, "wpm.", 4) == 0;
+            printf("  %-9s %-10s %10.2f %10.2f %10.2f  (%llu)\n", is_wpm ? "WPM" : "Accuracy", s->name + 4,
+                   kll_quantile(s, 0.5), kll_quantile(s, 0.9), kll_quantile(s, 0.99), s->n);
+        }
+        sketches_free(&set);
+    }
+    show_key_groups();
+    show_worst_transitions(TOP_N);
+    show_top_confusions(TOP_N);
+    printf("\nTop mistyped words:\n");
+    if (mwords->half_life > 0.0) {
+        printf("  (mistakes fade: half-life %.1f days)\n", mwords->half_life / 86400.0);
+    }
+    if (mwords->limit > 0) {
+        // Fehlerschranke der begrenzten Map: kleinster Zähler, höchstens N/k
+        long total = 0;
+        long bound = (mwords->n >= mwords->limit) ? mwords->items[mwords->heap[0]].count : 0;
+        char total_s[32], bound_s[32];
+        size_t i;
+        for (i = 0; i < mwords->n; i++) total += mwords->items[i].count;
+        map_count_text(mwords, total, total_s, sizeof(total_s));
+        map_count_text(mwords, bound, bound_s, sizeof(bound_s));
+        printf("  (top-%zu mode: %s mistakes counted; counts are at most %s too high,\n"
+               "   words not listed have at most %s mistakes; N/k = %.1f)\n",
+               mwords->limit, total_s, bound_s, bound_s, map_value(mwords, total) / (double)mwords->limit);
+    }
+    show_top_map(mwords, TOP_N);
+    printf("\nTop mistyped characters:\n");
+    show_top_map(mchars, TOP_N);
+    printf("=====================\n\n");
+}
+
+// ---------- Checkpoint-Log der laufenden Session ----------
+// Jedes ausgewertete Item wird als Datensatz an session.wal angehängt. Das write() passiert sofort,
+// ein Absturz, EOF oder Ctrl-C verliert also nichts. fsync nur gebündelt (Group Commit): nach
+// WAL_SYNC_ITEMS Items oder wenn der letzte fsync WAL_SYNC_MS zurückliegt, damit nicht jedes Item
+// auf die Platte wartet. Nach dem normalen Abschluss wird das Log gelöscht; liegt beim Start noch
+// eins da, wird die Session daraus nachgetragen.
+// Datensatz: u32 Länge, u32 Typ, Nutzdaten (auf 8 Bytes aufgefüllt), u64 Prüfsumme über alles davor.
+// Ein halb geschriebener letzter Datensatz fällt an der Prüfsumme auf und wird ignoriert.
+// Nur Sessions mit finish_session werden protokolliert. Training und SRS schreiben keine
+// Session-Statistik, SRS ändert zusätzlich den Zeitplan, ein Nachtragen passt dort nicht.
+
+#define WAL_FILE "session.wal"
+#define WAL_MAGIC "TTWAL\r\n\n"
+#define WAL_SYNC_ITEMS 16
+#define WAL_SYNC_MS 2000
+#define WAL_MAX_RECORD (16u << 20)
+
+enum { WAL_BEGIN = 1, WAL_ITEM = 2 };
+
+typedef struct {
+    int fd;
+    unsigned char *buf;     // Datensatz wird hier zusammengesetzt und mit einem write() geschrieben
+    size_t cap;
+    int pending;            // Datensätze seit dem letzten fsync
+    int64_t synced_ms;
+} WalLog;
+
+static WalLog wal = { -1, NULL, 0, 0, 0 };
+
+static void wal_write_all(const unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(wal.fd, p, len);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            perror("session.wal");
+            return;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+}
+
+static void wal_sync(void) {
+    if (wal.fd < 0 || wal.pending == 0) return;
+    fsync(wal.fd);
+    wal.pending = 0;
+    wal.synced_ms = now_ms();
+}
+
+// Datensatz aus n Teilen Nutzdaten anhängen
+static void wal_append(uint32_t type, const void **parts, const size_t *lens, int n) {
+    size_t len = 0, off = 8, padded, total;
+    uint32_t hdr[2];
+    uint64_t sum;
+    int i;
+    for (i = 0; i < n; i++) len += lens[i];
+    padded = (len + 7) & ~(size_t)7;
+    total = 8 + padded + 8;
+    if (total > wal.cap) {
+        unsigned char *nb = realloc(wal.buf, total);
+        if (nb == NULL) {
+            printf("Fehler bei malloc\n");
+            exit(1);
+        }
+        wal.buf = nb;
+        wal.cap = total;
+    }
+    hdr[0] = (uint32_t)len;
+    hdr[1] = type;
+    memcpy(wal.buf, hdr, 8);
+    for (i = 0; i < n; i++) {
+        memcpy(wal.buf + off, parts[i], lens[i]);
+        off += lens[i];
+    }
+    memset(wal.buf + off, 0, padded - len);
+    sum = snap_checksum(wal.buf, 8 + padded);
+    memcpy(wal.buf + 8 + padded, &sum, 8);
+    wal_write_all(wal.buf, total);
+    wal.pending++;
+}
+
+// Log für eine neue Session anlegen (ein altes wurde beim Start bereits nachgetragen)
+static int wal_begin(const char *mode) {
+    const void *parts[1];
+    size_t lens[1];
+    wal.fd = open(WAL_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (wal.fd < 0) {
+        perror("session.wal");
+        return 0;
+    }
+    wal_write_all((const unsigned char *)WAL_MAGIC, 8);
+    parts[0] = mode;
+    lens[0] = strlen(mode);
+    wal_append(WAL_BEGIN, parts, lens, 1);
+    wal_sync();     // Session-Beginn sofort festschreiben, danach gebündelt
+    return 1;
+}
+
+// Ausgewertetes Item festhalten. Referenz, Eingabe und Zeit reichen, um es beim Nachtragen
+// neu auszuwerten (das ergibt dieselben Fehlerzähler wie im Speicher).
+static void wal_item(const char *mode, const char *ref, const char *typed, double secs) {
+    uint32_t rlen = (uint32_t)strlen(ref);
+    const void *parts[4];
+    size_t lens[4];
+    if (wal.fd < 0 && !wal_begin(mode)) return;
+    parts[0] = &secs;
+    lens[0] = sizeof(secs);
+    parts[1] = &rlen;
+    lens[1] = sizeof(rlen);
+    parts[2] = ref;
+    lens[2] = rlen;
+    parts[3] = typed;
+    lens[3] = strlen(typed);
+    if (lens[0] + lens[1] + lens[2] + lens[3] > WAL_MAX_RECORD) return;
+    wal_append(WAL_ITEM, parts, lens, 4);
+    if (wal.pending >= WAL_SYNC_ITEMS || now_ms() - wal.synced_ms >= WAL_SYNC_MS) wal_sync();
+}
+
+// Session ist gespeichert: Log schliessen und löschen. Stürzt das Programm genau zwischen dem
+// Speichern der Maps und dem Löschen ab, werden die Fehler der Session beim Nachtragen doppelt gezählt.
+static void wal_done(void) {
+    if (wal.fd < 0) return;
+    close(wal.fd);
+    wal.fd = -1;
+    wal.pending = 0;
+    unlink(WAL_FILE);
+}
+
+// Summen über eine Übungssession
+typedef struct {
+    const char *mode;    // Name für die Statistik, z.B. "words"
+    int items;
+    size_t chars_typed;
+    size_t correct_chars;
+    size_t words;
+    size_t correct_words;
+    double seconds;
+} SessionTotals;
+
+// Ein Item üben: anzeigen, tippen lassen, auswerten und Fehler übernehmen.
+// Rückgabe 0, wenn die Eingabe zu Ende war (EOF / Ctrl-D), sonst 1
+static int practice_item(const char *ref, const int32_t *ref_ids, const char *header, Map *mwords, Map *mchars, SessionTotals *tot) {
+    const char *typed;
+    struct timeval start, end;
+    double secs;
+    CompareResult cres;
+    size_t typed_len;
+    double gross_wpm;
+    double accuracy;
+    int got_input;
+
+    // Eingabepuffer und Arena werden wiederverwendet: im Normalfall kein malloc/free pro Item
+    arena_reset(&item_arena);
+    printf("\n%s:\n%s\n", header, ref);
+    printf("Press ENTER when ready to start...");
+    read_line_tmp();
+
+    printf("Type it and press ENTER when done:\n> ");
+    gettimeofday(&start, NULL); //#include <sys/time.h>, time liefert nur Mikrosekunden, timeval ist ein Struct mit time_t tv_sec und susseconds_t tv_usec;
+    typed = read_typed(header, ref);
+    gettimeofday(&end, NULL); //#include <sys/time.h> 
+    got_input = (typed != NULL);
+    if (typed == NULL) typed = "";
+    secs = elapsed_seconds(start, end);
+    tot->seconds += secs;
+    tot->items++;
+
+    cres = compare_and_update(&item_arena, ref, ref_ids, typed, mwords, mchars);
+    wal_item(tot->mode, ref, typed, secs);
+    typed_len = strlen(typed);
+    tot->chars_typed += typed_len;
+    tot->correct_chars += cres.correct_chars;
+    tot->words += cres.total_words;
+    tot->correct_words += cres.correct_words;
+
+    //Gesamter Typing Speed egal ober fehlerhaft oder korrekt
+    item_scores(typed_len, cres.correct_chars, secs, &gross_wpm, &accuracy);
+
+    printf("\nResult for %s:\n", header);
+    //%.2f = 2 Kommastellen, %zu Format Specifier für einen size_t, %% für escaped % Zeichen
+    printf("  Time: %.2fs  Chars typed: %zu  Accuracy: %.2f%%  WPM (gross): %.2f\n",secs, typed_len, accuracy, gross_wpm); 
+
+    if (cres.total_words > 0) {
+        printf("  Words correct: %zu / %zu\n", cres.correct_words, cres.total_words);
+    }
+    if (cres.deleted_words + cres.inserted_words + cres.substituted_words > 0) {
+        printf("  Skipped: %zu  Extra: %zu  Mistyped: %zu\n",
+               cres.deleted_words, cres.inserted_words, cres.substituted_words);
+    }
+
+    if (cres.n_wrong > 0) {
+        printf("  Wrong words:\n");
+        show_top_items(cres.wrong, cres.n_wrong, (int)cres.n_wrong, NULL);
+    } else {
+        printf("  All words correct!\n");
+    }
+    return got_input;
+}
+
+// Zusammenfassung ausgeben, Statistik anhängen und Maps sowie die Zeichenmodelle speichern.
+// Erst danach wird das Checkpoint-Log gelöscht, sonst gingen die Deltas der Session bei einem Absturz verloren
+static void finish_session(const SessionTotals *tot, Map *mwords, Map *mchars) {
+    double gross_wpm_total;
+    double accuracy_total;
+
+    // gleiche Formel wie pro Item: WPM = Zeichen / 5 pro Minute, Genauigkeit = korrekte / getippte Zeichen
+    item_scores(tot->chars_typed, tot->correct_chars, tot->seconds, &gross_wpm_total, &accuracy_total);
+
+    printf("\n=== Session Summary ===\n");
+    printf("Items: %d  Total time: %.2fs  Total chars typed: %zu\n", tot->items, tot->seconds, tot->chars_typed);
+    printf("Gross WPM: %.2f   Accuracy: %.2f%%\n", gross_wpm_total, accuracy_total);
+
+    {
+        uint64_t t0 = metric_now_ns();
+        append_session_stats(tot->mode, gross_wpm_total, accuracy_total, (long)tot->chars_typed);
+        save_map_to_file(mwords, MWORDS_FILE);
+        save_map_to_file(mchars, MCHARS_FILE);
+        key_stats_save();
+        ngram_save();
+        confusion_save();
+        event_log_close();
+        wal_done();
+        metric_observe(MH_PERSIST, metric_now_ns() - t0);
+    }
+    metric_inc(MC_SESSIONS);
+    metrics_write();
+    printf("Session saved.\n");
+}
+
+// Beim Start: unvollständige Session aus session.wal neu auswerten und wie gewohnt abschliessen
+static void wal_recover(Map *mwords, Map *mchars) {
+    struct stat st;
+    unsigned char *data;
+    size_t size, pos = 8;
+    char mode[32] = "recovered";
+    SessionTotals tot;
+    int fd = open(WAL_FILE, O_RDONLY);
+    if (fd < 0) return;
+    if (fstat(fd, &st) != 0 || st.st_size < 8) {
+        close(fd);
+        unlink(WAL_FILE);
+        return;
+    }
+    size = (size_t)st.st_size;
+    data = malloc(size);
+    if (data == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    if (read(fd, data, size) != (ssize_t)size || memcmp(data, WAL_MAGIC, 8) != 0) {
+        printf("Ignoring unreadable %s.\n", WAL_FILE);
+        free(data);
+        close(fd);
+        unlink(WAL_FILE);
+        return;
+    }
+    close(fd);
+
+    memset(&tot, 0, sizeof(tot));
+    tot.mode = mode;
+    while (pos + 16 <= size) {
+        uint32_t hdr[2];
+        uint64_t sum;
+        size_t padded;
+        const unsigned char *p = data + pos + 8;
+        memcpy(hdr, data + pos, 8);
+        padded = ((size_t)hdr[0] + 7) & ~(size_t)7;
+        if (hdr[0] > WAL_MAX_RECORD || pos + 8 + padded + 8 > size) break;
+        memcpy(&sum, p + padded, 8);
+        if (sum != snap_checksum(data + pos, 8 + padded)) break;    // abgerissener letzter Datensatz
+        if (hdr[1] == WAL_BEGIN) {
+            size_t n = (hdr[0] < sizeof(mode)) ? hdr[0] : sizeof(mode) - 1;
+            memcpy(mode, p, n);
+            mode[n] = '\0';
+        } else if (hdr[1] == WAL_ITEM && hdr[0] >= 12) {
+            double secs;
+            uint32_t rlen;
+            size_t tlen;
+            char *ref, *typed;
+            CompareResult cres;
+            memcpy(&secs, p, 8);
+            memcpy(&rlen, p + 8, 4);
+            if (rlen > hdr[0] - 12) break;
+            tlen = hdr[0] - 12 - rlen;
+            arena_reset(&item_arena);
+            ref = arena_alloc(&item_arena, rlen + 1);
+            typed = arena_alloc(&item_arena, tlen + 1);
+            memcpy(ref, p + 12, rlen);
+            ref[rlen] = '\0';
+            memcpy(typed, p + 12 + rlen, tlen);
+            typed[tlen] = '\0';
+            cres = compare_texts(&item_arena, ref, NULL, typed, mwords, mchars);
+            tot.items++;
+            tot.seconds += secs;
+            tot.chars_typed += tlen;
+            tot.correct_chars += cres.correct_chars;
+            tot.words += cres.total_words;
+            tot.correct_words += cres.correct_words;
+        }
+        pos += 8 + padded + 8;
+    }
+    free(data);
+
+    if (tot.items > 0) {
+        printf("\nRecovered an unfinished %s session from %s (%d items).\n", mode, WAL_FILE, tot.items);
+        finish_session(&tot, mwords, mchars);
+    }
+    unlink(WAL_FILE);
+}
+
+// ---------- Passagen-Modus ----------
+// Ein beliebig langer Text wird als Stream gelesen und in Abschnitten von etwa PASSAGE_CHUNK Bytes
+// (an Wortgrenzen) geübt. Im Speicher liegt immer nur der aktuelle Abschnitt.
+
+#define PASSAGE_CHUNK 160       // Zielgrösse eines Abschnitts in Bytes
+#define PASSAGE_CHUNK_MAX 640   // harte Grenze, falls ein "Wort" länger ist
+
+typedef struct {
+    FILE *f;
+    char buf[PASSAGE_CHUNK_MAX + 8];
+    size_t len;
+    int carry;   // bereits gelesenes Zeichen für den nächsten Abschnitt (EOF = keins)
+} PassageReader;
+
+// Nächsten Abschnitt lesen. Zeilenumbrüche und Tabs werden zu einfachen Leerzeichen,
+// damit der Abschnitt auf einer Zeile getippt werden kann. Rückgabe 0 am Ende des Texts
+static int passage_next(PassageReader *pr) {
+    int c;
+    int space = 0;
+    pr->len = 0;
+    while (1) {
+        if (pr->carry != EOF) {
+            c = pr->carry;
+            pr->carry = EOF;
+        } else {
+            c = fgetc(pr->f);
+        }
+        if (c == EOF) break;
+        if (c == '\r') continue;
+        if (isspace((unsigned char)c)) {
+            if (pr->len > 0) space = 1;
+            // Abschnitt ist gross genug: am Wortende abschliessen
+            if (pr->len >= PASSAGE_CHUNK) break;
+            continue;
+        }
+        if (space) {
+            pr->buf[pr->len++] = ' ';
+            space = 0;
+        }
+        // sehr lange Wörter hart trennen, wenn möglich nicht mitten in einem UTF-8 Zeichen
+        if (pr->len >= PASSAGE_CHUNK_MAX && (((unsigned char)c & 0xC0) != 0x80 || pr->len >= PASSAGE_CHUNK_MAX + 4)) {
+            pr->carry = c;
+            break;
+        }
+        pr->buf[pr->len++] = (char)c;
+    }
+    pr->buf[pr->len] = '\0';
+    return pr->len > 0;
+}
+
+// Text aus einer Datei abschnittsweise üben, Ctrl-D beendet vorzeitig
+static void passage_practice(Map *mwords, Map *mchars) {
+    char *path;
+    PassageReader pr;
+    SessionTotals tot;
+    int chunk = 0;
+
+    printf("Path to a text file: ");
+    path = read_line();
+    if (path == NULL) return;
+    pr.f = fopen(path, "r");
+    if (pr.f == NULL) {
+        perror(path);
+        free(path);
+        return;
+    }
+    free(path);
+    pr.len = 0;
+    pr.carry = EOF;
+    memset(&tot, 0, sizeof(tot));
+    tot.mode = "passage";
+
+    printf("Passage mode: the text is shown in parts. Press Ctrl-D to stop early.\n");
+    while (passage_next(&pr)) {
+        char header[64];
+        snprintf(header, sizeof(header), "Part %d", ++chunk);
+        if (!practice_item(pr.buf, NULL, header, mwords, mchars, &tot)) break;
+    }
+    fclose(pr.f);
+    if (tot.items > 0) finish_session(&tot, mwords, mchars);
+}
+
+// ---------- Test auf Zeit ----------
+// So viel wie möglich in einer festen Zeit tippen. Die Sätze folgen ohne Pause aufeinander, beim Ablauf
+// wird mitten im Item gestoppt und der bis dahin getippte Teil normal ausgewertet.
+
+#define TIMED_DEFAULT_SECS 60
+
+static void timed_practice(Map *mwords, Map *mchars) {
+    char *line;
+    long secs;
+    struct itimerspec its;
+    struct timeval start, end, prev;
+    SessionTotals tot;
+
+    if (!live_view) {
+        printf("Timed tests need the live view (run in a terminal without --no-live).\n");
+        return;
+    }
+    // die Eingabe muss beim Ablauf abbrechen können, also Raw-Modus vorab prüfen
+    if (term_raw() != 0) {
+        printf("Timed tests need raw terminal mode, which this terminal does not support.\n");
+        return;
+    }
+    term_restore();
+    printf("Test duration in seconds? (e.g. %d): ", TIMED_DEFAULT_SECS);
+    line = read_line();
+    if (line == NULL) return;
+    secs = atol(line);
+    free(line);
+    if (secs <= 0) secs = TIMED_DEFAULT_SECS;
+
+    timed.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timed.fd < 0) {
+        perror("timerfd_create");
+        return;
+    }
+    printf("Press ENTER to start the %ld second test...", secs);
+    if (read_line_tmp() == NULL) {
+        close(timed.fd);
+        timed.fd = -1;
+        return;
+    }
+
+    // Takt jede Sekunde ab jetzt: der secs-te Takt ist genau der Ablauf (periodisch, driftet nicht)
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = 1;
+    its.it_interval.tv_sec = 1;
+    timed.left = secs;
+    memset(&tot, 0, sizeof(tot));
+    tot.mode = "timed";
+    timerfd_settime(timed.fd, 0, &its, NULL);
+    gettimeofday(&start, NULL);
+    prev = start;
+
+    while (!timed_expired()) {
+        const LangSentence *s = &lang.sentences[randint(0, (int)lang.sentence_n - 1)];
+        const char *ref = s->text;
+        const int32_t *ids = s->ids;
+        const char *typed;
+        size_t typed_len;
+        size_t frag_correct = 0;
+        CompareResult cres;
+        char header[64];
+
+        arena_reset(&item_arena);
+        snprintf(header, sizeof(header), "Timed test (%lds) - item %d", secs, tot.items + 1);
+        typed = read_typed(header, ref);
+        if (typed == NULL) break;   // Ctrl-D bricht den Test ab
+        typed_len = strlen(typed);
+        if (timed.left <= 0) {
+            // abgebrochenes Item: nur so viele Zeichen der Referenz werten, wie getippt wurden
+            size_t tn, rn;
+            if (typed_len == 0) break;
+            tn = utf8_starts(typed, typed_len, &live_tstart, &live_tcap);
+            rn = utf8_starts(ref, strlen(ref), &live_rstart, &live_rcap);
+            if (tn < rn) {
+                size_t rcut = live_rstart[tn];      // Zeichengrenze, auch bei Umlauten
+                size_t tcut = typed_len;
+                char *r, *t;
+                if (ref[rcut] != ' ' && typed[typed_len - 1] != ' ') {
+                    // letztes Wort nur angefangen: nicht als (falsches) Wort werten, seine Zeichen
+                    // zählen nur für Genauigkeit und WPM
+                    size_t i;
+                    while (rcut > 0 && ref[rcut - 1] != ' ') rcut--;
+                    while (tcut > 0 && typed[tcut - 1] != ' ') tcut--;
+                    for (i = 0; tcut + i < typed_len && ref[rcut + i] != '\0' && ref[rcut + i] != ' '; i++) {
+                        if (typed[tcut + i] == ref[rcut + i]) frag_correct++;
+                    }
+                }
+                r = arena_strdup(&item_arena, ref);
+                r[rcut] = '\0';
+                t = arena_strdup(&item_arena, typed);
+                t[tcut] = '\0';
+                ref = r;
+                typed = t;
+                ids = NULL;
+            }
+        }
+        cres = compare_and_update(&item_arena, ref, ids, typed, mwords, mchars);
+        gettimeofday(&end, NULL);
+        wal_item(tot.mode, ref, typed, elapsed_seconds(prev, end));
+        prev = end;
+        tot.items++;
+        tot.chars_typed += typed_len;
+        tot.correct_chars += cres.correct_chars + frag_correct;
+        tot.words += cres.total_words;
+        tot.correct_words += cres.correct_words;
+    }
+    gettimeofday(&end, NULL);
+    close(timed.fd);
+    timed.fd = -1;
+
+    tot.seconds = elapsed_seconds(start, end);
+    if (tot.items == 0) {
+        printf("\nNothing typed.\n");
+        return;
+    }
+    printf("\nWords correct: %zu / %zu\n", tot.correct_words, tot.words);
+    finish_session(&tot, mwords, mchars);
+}
+
+// Führe eine Übungssession mit Wort- oder Satzelementen durch
+static void start_practice(Map *mwords, Map *mchars) {
+    char *choice;
+    int mode;
+    char *numberitems;
+    int n;
+    int i;
+    int level;
+    SessionTotals tot;
+
+    printf("\nStart Practice\n");
+    printf("1) Word practice\n2) Sentence practice\n3) Passage from a text file\n4) Timed test\nEnter choice: ");
+    choice = read_line(); //malloc innerhalb der Funktion
+    if (choice == NULL) return;
+    mode = atoi(choice);
+    free(choice);
+    if (mode == 3) {
+        passage_practice(mwords, mchars);
+        return;
+    }
+    if (mode == 4) {
+        timed_practice(mwords, mchars);
+        return;
+    }
+    if (mode != 1 && mode != 2) {
+        printf("Invalid choice.\n");
+        return;
+    }
+
+    printf("How many items in this session? (e.g. 10): ");
+    numberitems = read_line();
+    if (numberitems == NULL) return;
+    n = atoi(numberitems);
+    free(numberitems);
+    if (n <= 0) n = 10;
+
+    printf("Difficulty level 1-%d (ENTER = any): ", DIFF_LEVELS);
+    choice = read_line();
+    if (choice == NULL) return;
+    level = atoi(choice);
+    free(choice);
+    if (level < 1 || level > DIFF_LEVELS) {
+        level = 0;
+    } else {
+        const DiffIndex *d;
+        size_t lo, hi;
+        diff_ensure();
+        d = (mode == 1) ? &diff_words : &diff_sentences;
+        diff_band(d, level, &lo, &hi);
+        if (d->n > 0) printf("Level %d: difficulty %.1f - %.1f\n", level, d->score[lo], d->score[hi - 1]);
+    }
+
+    memset(&tot, 0, sizeof(tot));
+    tot.mode = (mode == 1) ? "words" : "sentences";
+    for (i = 0; i < n; i++) {
+        const char *ref; //Value ist Konstant, Adresse kann sicher ändern, Value kann nicht angepasst werden
+        const int32_t *ids;
+        char header[64];
+
+        if (mode == 1) {
+            size_t k = (level > 0) ? diff_pick(&diff_words, level) : (size_t)randint(0, (int)lang.bank_n - 1); //-1 da von 0, eigene Funktion mit Modulo
+            ids = &lang.bank[k];
+            ref = lang.words[*ids];
+        } else {
+            size_t k = (level > 0) ? diff_pick(&diff_sentences, level) : (size_t)randint(0, (int)lang.sentence_n - 1);
+            const LangSentence *s = &lang.sentences[k];
+            ref = s->text;
+            ids = s->ids;
+        }
+        snprintf(header, sizeof(header), "Item %d/%d", i + 1, n);
+        practice_item(ref, ids, header, mwords, mchars, &tot);
+    }
+    finish_session(&tot, mwords, mchars);
+}
+
+// ---------- Spaced Repetition (SM-2) für falsch getippte Wörter ----------
+// Jedes Wort aus der Wörterfehler-Map bekommt Ease-Faktor, Intervall und nächsten Termin.
+// Fällige Wörter liegen in einem Min-Heap nach Termin, das nächste Wort zu holen kostet O(log n).
+// Gespeichert wird neben mistakes_words.txt (Format: "wort\tease\tinterval_tage\twiederholungen\tfällig_epoch\n").
+
+#define SRS_FILE "mistakes_words.srs"
+#define SRS_START_EASE 2.5
+#define SRS_MIN_EASE 1.3
+#define SRS_RELEARN_SECS 600     // falsch getippte Wörter nach 10 Minuten nochmals
+
+typedef struct {
+    char *word;
+    double ease;
+    double interval;   // Tage
+    int reps;          // erfolgreiche Wiederholungen in Folge
+    time_t due;
+    size_t heap_pos;
+} SrsItem;
+
+typedef struct {
+    SrsItem *items;
+    size_t n;
+    size_t cap;
+    size_t *heap;      // Indizes in items, Min-Heap nach due
+    Map lookup;        // Wort -> Index in items (als count gespeichert)
+} SrsScheduler;
+
+static void srs_heap_swap(SrsScheduler *s, size_t a, size_t b) {
+    size_t t = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = t;
+    s->items[s->heap[a]].heap_pos = a;
+    s->items[s->heap[b]].heap_pos = b;
+}
+
+static void srs_sift_up(SrsScheduler *s, size_t pos) {
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (s->items[s->heap[parent]].due <= s->items[s->heap[pos]].due) break;
+        srs_heap_swap(s, pos, parent);
+        pos = parent;
+    }
+}
+
+static void srs_sift_down(SrsScheduler *s, size_t pos) {
+    while (1) {
+        size_t l = 2 * pos + 1;
+        size_t r = l + 1;
+        size_t m = pos;
+        if (l < s->n && s->items[s->heap[l]].due < s->items[s->heap[m]].due) m = l;
+        if (r < s->n && s->items[s->heap[r]].due < s->items[s->heap[m]].due) m = r;
+        if (m == pos) break;
+        srs_heap_swap(s, pos, m);
+        pos = m;
+    }
+}
+
+static void srs_init(SrsScheduler *s) {
+    s->items = NULL;
+    s->n = 0;
+    s->cap = 0;
+    s->heap = NULL;
+    map_init(&s->lookup);
 }
 
-// Referenz- und eingegebenen Text vergleichen, mistake maps aktualisieren, Ergebnisse zurückgeben
-static CompareResult compare_and_update(const char *ref, const char *typed, Map *mwords, Map *mchars) {
-    CompareResult res = {0, 0, 0, 0};
-    if (ref == NULL) ref = "";
-    if (typed == NULL) typed = "";
-    size_t rlen = strlen(ref);
-    size_t tlen = strlen(typed);
-    res.total_chars = rlen;
-    size_t minlen = (rlen < tlen) ? rlen : tlen;
+static void srs_free(SrsScheduler *s) {
+    size_t i;
+    for (i = 0; i < s->n; i++) free(s->items[i].word);
+    free(s->items);
+    free(s->heap);
+    map_free(&s->lookup);
+    srs_init(s);
+}
 
-    // Vergleiche Zeichen
-    for (size_t i = 0; i < minlen; i++) {
-        if (typed[i] == ref[i]) {
-            res.correct_chars++;
+// Wort aufnehmen (falls noch nicht vorhanden), Rückgabe Index in items
+static size_t srs_add(SrsScheduler *s, const char *word, double ease, double interval, int reps, time_t due) {
+    long found = map_find(&s->lookup, word);
+    SrsItem *it;
+    if (found >= 0) return (size_t)s->lookup.items[found].count;
+    if (s->n == s->cap) {
+        size_t newcap = (s->cap == 0) ? 16 : s->cap * 2;
+        SrsItem *tmp = realloc(s->items, newcap * sizeof(SrsItem));
+        size_t *htmp = realloc(s->heap, newcap * sizeof(size_t));
+        if (tmp == NULL || htmp == NULL) {
+            printf("Fehler bei realloc\n");
+            exit(1);
         }
+        s->items = tmp;
+        s->heap = htmp;
+        s->cap = newcap;
     }
+    it = &s->items[s->n];
+    it->word = dup_string(word);
+    it->ease = ease;
+    it->interval = interval;
+    it->reps = reps;
+    it->due = due;
+    it->heap_pos = s->n;
+    s->heap[s->n] = s->n;
+    map_add(&s->lookup, word, (long)s->n);
+    s->n++;
+    srs_sift_up(s, s->n - 1);
+    return s->n - 1;
+}
 
-    // Wortvergleich
-    char ref_words[50][256];
-    char typed_words[50][256];
-    int num_ref = collect_words(ref, ref_words, 50);
-    int num_typed = collect_words(typed, typed_words, 50);
-    res.total_words = num_ref;
-    res.correct_words = 0;
-    int min_num = (num_ref < num_typed) ? num_ref : num_typed;
-    for (int k = 0; k < min_num; k++) {
-        if (strcmp(ref_words[k], typed_words[k]) == 0) {
-            res.correct_words++;
-        } else {
-            map_add(mwords, ref_words[k], 1);
-            add_char_mistakes(ref_words[k], typed_words[k], mchars);
-        }
-    }
-    for (int k = min_num; k < num_ref; k++) {
-        map_add(mwords, ref_words[k], 1);
+// Zustand aus SRS_FILE laden
+static void srs_load(SrsScheduler *s) {
+    FILE *f = fopen(SRS_FILE, "r");
+    char *line = NULL;
+    size_t line_cap = 0;
+    if (f == NULL) return;
+    while (getline(&line, &line_cap, f) >= 0) {
+        char *tab = strchr(line, '\t');
+        double ease, interval;
+        int reps;
+        long long due;
+        if (tab == NULL) continue;
+        *tab = '\0';
+        if (sscanf(tab + 1, "%lf\t%lf\t%d\t%lld", &ease, &interval, &reps, &due) != 4) continue;
+        if (ease < SRS_MIN_EASE) ease = SRS_MIN_EASE;
+        srs_add(s, line, ease, interval, reps, (time_t)due);
     }
-
-    return res;
+    free(line);
+    fclose(f);
 }
 
-// Generiere eine Zufallszahl im Bereich [a, b]
-static int randint(int a, int b) {
-    return a + rand() % (b - a + 1); // +1 damit das obere Ende b inklusiv ist (Intervall [a,b] statt [a,b))
+static void srs_save(const SrsScheduler *s) {
+    FILE *f = fopen(SRS_FILE, "w");
+    size_t i;
+    if (f == NULL) {
+        perror("fopen srs");
+        return;
+    }
+    for (i = 0; i < s->n; i++) {
+        const SrsItem *it = &s->items[i];
+        fprintf(f, "%s\t%.3f\t%.3f\t%d\t%lld\n", it->word, it->ease, it->interval, it->reps, (long long)it->due);
+    }
+    fclose(f);
 }
 
-// Lese eine Zeile von stdin ein
-static char *read_line(void) {
-    //Buffer nur innerhalb der Funktion
-    char buffer[MAX_LINE];
-    char *line;
-    size_t len;
-
-    //Wenn fgets Null zurückgibt > keine Zeile gelesen
-    if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
-        return NULL;
+// Bewertung nach SM-2 (quality 0..5) anwenden und den Termin im Heap nachführen
+static void srs_grade(SrsScheduler *s, size_t idx, int quality, time_t now) {
+    SrsItem *it = &s->items[idx];
+    double q = (double)(5 - quality);
+    it->ease += 0.1 - q * (0.08 + q * 0.02);
+    if (it->ease < SRS_MIN_EASE) it->ease = SRS_MIN_EASE;
+    if (quality >= 3) {
+        if (it->reps == 0) it->interval = 1.0;
+        else if (it->reps == 1) it->interval = 6.0;
+        else it->interval = it->interval * it->ease;
+        it->reps++;
+        it->due = now + (time_t)(it->interval * 86400.0);
+    } else {
+        it->reps = 0;
+        it->interval = 0.0;
+        it->due = now + SRS_RELEARN_SECS;
     }
-    trim_newline(buffer);
-    len = strlen(buffer);
-    
-    // Genau passend Speicher len Zeichen + 1 Byte für das '\0'
-    line = (char*)malloc(len + 1);
-    if (line == NULL) {
-        printf("Fehler bei malloc\n");
-        exit(1); //Abbrechen wenn kein Speicher verfügbar ist
+    // Termin liegt nur später: nach unten sickern reicht
+    srs_sift_down(s, it->heap_pos);
+}
+
+// Qualität 0..5 aus dem Ergebnis eines Versuchs ableiten
+static int srs_quality(const CompareResult *cres, double accuracy, double gross_wpm) {
+    if (cres->total_words > 0 && cres->correct_words == cres->total_words) {
+        if (gross_wpm >= 40.0) return 5;
+        if (gross_wpm >= 20.0) return 4;
+        return 3;
     }
-    strcpy(line, buffer);
-    //buffer verschwindet nach Funktionsende (Stack daher kein Free), line bleibt gültig Heap dynamischer Speicher bis free verwendet wird
-    return line;
+    if (accuracy >= 80.0) return 2;
+    if (accuracy >= 50.0) return 1;
+    return 0;
 }
 
-// Zeige die Top N Einträge aus der Map, sortiert nach Anzahl
-static void show_top_map(Map *m, int n) {
+// Fällige Wörter wiederholen (alle Wörter der Fehler-Map nehmen teil)
+static void srs_review(Map *mwords, Map *mchars) {
+    SrsScheduler s;
     size_t i;
+    time_t now = time(NULL);
     int limit;
-    KeyCount *copy;
+    int done = 0;
+    char *str;
 
-    if (m->n == 0) {
-        printf("  (none)\n");
-        return;
+    srs_init(&s);
+    srs_load(&s);
+    for (i = 0; i < mwords->n; i++) {
+        srs_add(&s, mwords->items[i].key, SRS_START_EASE, 0.0, 0, now); // neue Wörter sind sofort fällig
     }
-    //Originaldaten der Map nicht verändern > Deshalb eine Kopie
-    copy = malloc(m->n * sizeof(KeyCount));
-    if (copy == NULL) {
-        printf("Fehler bei malloc\n");
+    if (s.n == 0 || s.items[s.heap[0]].due > now) {
+        if (s.n > 0) {
+            double wait = difftime(s.items[s.heap[0]].due, now);
+            printf("Nothing due. Next review in %.0f minutes.\n", wait / 60.0);
+        } else {
+            printf("No words to review.\n");
+        }
+        srs_free(&s);
         return;
     }
 
-    for (i = 0; i < m->n; i++) {
-        copy[i] = m->items[i];
+    printf("How many reviews at most? (e.g. 20): ");
+    str = read_line();
+    if (str == NULL) {
+        srs_free(&s);
+        return;
     }
-    qsort(copy, m->n, sizeof(KeyCount), cmp_kc_desc); //generisches Sortieren per Compare-Funktion (Array-Pointer, Anzahl Elemente, Grösse eine Elements, Vergleichsfunktion)
+    limit = atoi(str);
+    free(str);
+    if (limit <= 0) limit = 20;
 
-    //Wenn n grösser als das eigentliche Array ist
-    if (n < (int)m->n) {
-        limit = n;
-    } else {
-        limit = (int)m->n;
-    }
+    while (done < limit && s.items[s.heap[0]].due <= now) {
+        size_t idx = s.heap[0];
+        const char *ref = s.items[idx].word;
+        const char *typed;
+        struct timeval start, end;
+        CompareResult cres;
+        double secs, gross_wpm, accuracy;
+        int quality;
 
-    for (i = 0; i < (size_t)limit; i++) {
-        //%d = int, %-12s = mind. Länge von 12 Zeichen daher alle ":" untereinander, %ld  = Long Count Wert
-        printf("  %d) %-12s : %ld\n", (int)i + 1, copy[i].key, copy[i].count);
+        arena_reset(&item_arena);
+        printf("\n%s\nPress ENTER when ready...", ref);
+        read_line_tmp();
+        printf("Type: ");
+        gettimeofday(&start, NULL);
+        typed = read_typed("Review", ref);
+        gettimeofday(&end, NULL);
+        if (typed == NULL) break;
+
+        cres = compare_and_update(&item_arena, ref, NULL, typed, mwords, mchars);
+        secs = elapsed_seconds(start, end);
+        item_scores(strlen(typed), cres.correct_chars, secs, &gross_wpm, &accuracy);
+        quality = srs_quality(&cres, accuracy, gross_wpm);
+        now = time(NULL);
+        srs_grade(&s, idx, quality, now);
+        printf("  Result: Time %.2fs  WPM %.2f  Accuracy %.2f%%  Grade %d/5  Next in %.1f days\n",
+               secs, gross_wpm, accuracy, quality, difftime(s.items[idx].due, now) / 86400.0);
+        done++;
     }
 
-    free(copy);
+    srs_save(&s);
+    srs_free(&s);
+    save_map_to_file(mwords, MWORDS_FILE);
+    save_map_to_file(mchars, MCHARS_FILE);
+    printf("Review done (%d words).\n", done);
 }
 
-// Zeige Gesamtstatistiken und Top-Fehler an
-static void view_statistics(Map *mwords, Map *mchars) {
-    double avg_wpm, best_wpm, avg_acc;
-    size_t sessions;
+// ---------- Markov-Generator für neue Übungswörter ----------
+// Zeichenweises Markov-Modell 2. Ordnung, trainiert auf allen Wörtern des Sprachpakets: Zustand sind die
+// zwei vorherigen Buchstaben (Latin-1, 0 = Wortanfang/-ende). Pro Zustand liegt eine Alias-Tabelle vor,
+// ein Zeichen zu ziehen kostet eine Zufallszahl und einen Vergleich. Die Übergänge werden zu Zeichen
+// verschoben, die in mistakes_chars.txt oft vorkommen, so entstehen aussprechbare Kunstwörter mit den
+// schwachen Zeichen des Benutzers.
 
-    compute_aggregate_stats(&avg_wpm, &best_wpm, &avg_acc, &sessions);
+#define MARKOV_MIN_LEN 3
+#define MARKOV_MAX_LEN 14
+#define MARKOV_BIAS 3.0     // das schwächste Zeichen wird bis zu (1 + MARKOV_BIAS)-mal so oft gewählt
+#define MARKOV_TRIES 16     // Versuche für ein Wort, das nicht schon im Sprachpaket steht
 
-    printf("\n=== Statistics ===\n");
-    printf("Sessions recorded: %zu\n", sessions); //%zu Format Specifier für size_t
-    if (sessions > 0) {
-        printf("Average WPM: %.2f\n", avg_wpm);
-        printf("Best WPM   : %.2f\n", best_wpm);
-        printf("Average Accuracy: %.2f%%\n", avg_acc);
-    }
-    printf("\nTop mistyped words:\n");
-    show_top_map(mwords, TOP_N);
-    printf("\nTop mistyped characters:\n");
-    show_top_map(mchars, TOP_N);
-    printf("=====================\n\n");
+typedef struct {
+    uint32_t first;         // erster Eintrag in next/prob/alias
+    uint32_t n;
+} MarkovState;
+
+typedef struct {
+    uint32_t *state_of;     // [vor2 * 256 + vor1] -> Zustandsnummer + 1 (0 = kein Übergang)
+    MarkovState *states;
+    size_t nstates;
+    unsigned char *next;    // Folgezeichen pro Eintrag (0 = Wortende)
+    uint32_t *prob;         // Alias-Methode: Schwelle (von 2^32) pro Eintrag
+    uint32_t *alias;        // sonst dieser Eintrag (relativ zum ersten des Zustands)
+    size_t nentries;
+    uint64_t rng;           // xorshift64*
+} Markov;
+
+static Markov markov;
+
+static int markov_letter(int c) {
+    return (c < 0x80) ? isalpha(c) : (c >= 0xC0 && c != 0xD7 && c != 0xF7);
 }
 
-// Führe eine Übungssession mit Wort- oder Satzelementen durch
-static void start_practice(Map *mwords, Map *mchars) {
-    char *choice;
-    int mode;
-    char *numberitems;
-    int n;
-    int i;
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x < y) ? -1 : (x > y);
+}
 
-    printf("\nStart Practice\n");
-    printf("1) Word practice\n2) Sentence practice\nEnter choice: ");
-    choice = read_line(); //malloc innerhalb der Funktion
-    if (choice == NULL) return;
-    mode = atoi(choice);
-    free(choice);
-    if (mode != 1 && mode != 2) {
-        printf("Invalid choice.\n");
-        return;
+// Alias-Tabelle (Vose) für die Gewichte w[0..n) in prob/alias ab Eintrag first aufbauen
+static void markov_alias(Markov *m, uint32_t first, uint32_t n, double *w, uint32_t *small, uint32_t *large) {
+    double sum = 0.0;
+    uint32_t ns = 0, nl = 0, i;
+    for (i = 0; i < n; i++) sum += w[i];
+    for (i = 0; i < n; i++) {
+        w[i] = w[i] * n / sum;
+        if (w[i] < 1.0) small[ns++] = i;
+        else large[nl++] = i;
     }
+    while (ns > 0 && nl > 0) {
+        uint32_t s = small[--ns];
+        uint32_t l = large[nl - 1];
+        m->prob[first + s] = (uint32_t)(w[s] * 4294967295.0);
+        m->alias[first + s] = l;
+        w[l] -= 1.0 - w[s];
+        if (w[l] < 1.0) {
+            nl--;
+            small[ns++] = l;
+        }
+    }
+    while (nl > 0) {
+        uint32_t l = large[--nl];
+        m->prob[first + l] = 0xFFFFFFFFu;
+        m->alias[first + l] = l;
+    }
+    while (ns > 0) {
+        uint32_t s = small[--ns];   // nur Rundungsreste
+        m->prob[first + s] = 0xFFFFFFFFu;
+        m->alias[first + s] = s;
+    }
+}
 
-    printf("How many items in this session? (e.g. 10): ");
-    numberitems = read_line();
-    if (numberitems == NULL) return;
-    n = atoi(numberitems);
-    free(numberitems);
-    if (n <= 0) n = 10;
-
-    { //Gültigkeitsbereich
-        size_t total_chars_typed = 0;
-        size_t total_correct_chars = 0;
-        size_t total_words = 0;
-        size_t total_correct_words = 0;
-        double total_seconds = 0.0;
-
-        for (i = 0; i < n; i++) {
-            const char *ref; //Value ist Konstant, Adresse kann sicher ändern, Value kann nicht angepasst werden
-            char *tmp;
-            char *typed;
-            struct timeval start, end;
-            double secs;
-            CompareResult cres;
-            double minutes;
-            double gross_wpm;
-            double accuracy;
+// Modell aus dem Sprachpaket trainieren, gewichtet mit den Zeichenfehlern in mchars
+static void markov_build(Markov *m, const Map *mchars, uint64_t seed) {
+    double weak[256] = {0};
+    double max_count = 0.0;
+    uint32_t *tr = NULL;        // Übergänge als vor2 << 16 | vor1 << 8 | zeichen
+    size_t ntr = 0, cap = 0, i, j;
+    double *w;
+    uint32_t *small, *large;
 
-            if (mode == 1) {
-                ref = word_bank[randint(0, (int)word_bank_count - 1)]; //-1 da von 0, eigene Funktion mit Modulo
-            } else {
-                ref = sentence_bank[randint(0, (int)sentence_bank_count - 1)]; //-1 da von 0, eigene Funktion mit Modulo
-            }
-
-            printf("\nItem %d/%d:\n%s\n", i + 1, n, ref);
-            printf("Press ENTER when ready to start...");
-            tmp = read_line();
-            //free tmp wenn ungleich null da durch read_line ein malloc durchgeführt wurde, die Nummer wird nicht mehr benötigt
-            if (tmp != NULL) free(tmp);
-
-            printf("Type it and press ENTER when done:\n> ");
-            gettimeofday(&start, NULL); //#include <sys/time.h>, time liefert nur Mikrosekunden, timeval ist ein Struct mit time_t tv_sec und susseconds_t tv_usec;
-            typed = read_line();
-            gettimeofday(&end, NULL); //#include <sys/time.h> 
-            if (typed == NULL) {
-                typed = (char*)malloc(1);
-                if (typed == NULL) { printf("Fehler bei malloc\n"); exit(1); }
-                typed[0] = '\0';
-            }
-            secs = elapsed_seconds(start, end);
-            total_seconds += secs;
-
-            Map item_mwords;
-            map_init(&item_mwords);
-
-            cres = compare_and_update(ref, typed, &item_mwords, mchars);
-            total_chars_typed += strlen(typed);
-            total_correct_chars += cres.correct_chars;
-            total_words += cres.total_words;
-            total_correct_words += cres.correct_words;
-
-            
-            minutes = secs / 60.0;
-            //Gesamter Typing Speed egal ober fehlerhaft oder korrekt
-            gross_wpm = 0.0;
-            if (minutes > 0.0) {
-                gross_wpm = ((double)strlen(typed) / 5.0) / minutes; //double da Kommazahlen, /5 da Standardwert für ein Wort
-            }
-            if (strlen(typed) > 0) {
-                accuracy = ((double)cres.correct_chars / (double)strlen(typed)) * 100.0; //double da Kommazahlen
-            } else {
-                accuracy = 0.0;
-            }
+    memset(m, 0, sizeof(*m));
+    m->rng = seed ? seed : 0x9E3779B97F4A7C15ull;
 
-            printf("\nResult for item %d:\n", i + 1);
-            //%.2f = 2 Kommastellen, %zu Format Specifier für einen size_t, %% für escaped % Zeichen
-            printf("  Time: %.2fs  Chars typed: %zu  Accuracy: %.2f%%  WPM (gross): %.2f\n",secs, strlen(typed), accuracy, gross_wpm); 
+    // Schwäche pro Zeichen: Fehler relativ zum häufigsten Fehlerzeichen
+    for (i = 0; mchars != NULL && i < mchars->n; i++) {
+        const char *k = mchars->items[i].key;
+        int c = latin1_next(&k, strlen(k));
+        if (c > 0 && *k == '\0') {
+            int lc = (c < 0x80) ? tolower(c) : c;
+            weak[lc] += (double)mchars->items[i].count;
+            if (weak[lc] > max_count) max_count = weak[lc];
+        }
+    }
+    for (i = 0; i < 256; i++) {
+        weak[i] = (max_count > 0.0) ? weak[i] / max_count : 0.0;
+    }
 
-            if (cres.total_words > 0) {
-                printf("  Words correct: %zu / %zu\n", cres.correct_words, cres.total_words);
+    for (i = 0; i < lang.nwords; i++) {
+        const char *p = lang.words[i];
+        const char *end = p + strlen(p);
+        int a = 0, b = 0;
+        while (1) {
+            int c = (p < end) ? latin1_next(&p, (size_t)(end - p)) : 0;
+            if (c < 0 || (c != 0 && !markov_letter(c))) {
+                // Satzzeichen, Ziffern usw. trennen Wortteile
+                if (c < 0) p++;
+                c = 0;
             }
+            if (c == 0 && b == 0) {
+                if (p >= end) break;
+                continue;
+            }
+            if (ntr == cap) {
+                cap = cap ? cap * 2 : 4096;
+                tr = realloc(tr, cap * sizeof(uint32_t));
+                if (tr == NULL) {
+                    printf("Fehler bei realloc\n");
+                    exit(1);
+                }
+            }
+            tr[ntr++] = (uint32_t)a << 16 | (uint32_t)b << 8 | (uint32_t)c;
+            a = b;
+            b = c;
+            if (c == 0) {
+                a = 0;
+                if (p >= end) break;
+            }
+        }
+    }
+    qsort(tr, ntr, sizeof(uint32_t), cmp_u32);
 
-            if (item_mwords.n > 0) {
-                printf("  Wrong words:\n");
-                show_top_map(&item_mwords, item_mwords.n);
-            } else {
-                printf("  All words correct!\n");
+    m->state_of = calloc(256 * 256, sizeof(uint32_t));
+    m->states = malloc((ntr + 1) * sizeof(MarkovState));
+    m->next = malloc(ntr + 1);
+    m->prob = malloc((ntr + 1) * sizeof(uint32_t));
+    m->alias = malloc((ntr + 1) * sizeof(uint32_t));
+    w = malloc(257 * sizeof(double));
+    small = malloc(257 * sizeof(uint32_t));
+    large = malloc(257 * sizeof(uint32_t));
+    if (m->state_of == NULL || m->states == NULL || m->next == NULL || m->prob == NULL || m->alias == NULL ||
+        w == NULL || small == NULL || large == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    // sortierte Übergänge: gleiche Zustände und gleiche Folgezeichen liegen nebeneinander
+    for (i = 0; i < ntr; ) {
+        uint32_t st = tr[i] >> 8;
+        MarkovState *s = &m->states[m->nstates];
+        s->first = (uint32_t)m->nentries;
+        s->n = 0;
+        while (i < ntr && (tr[i] >> 8) == st) {
+            unsigned char c = (unsigned char)(tr[i] & 0xFF);
+            for (j = i; j < ntr && tr[j] == tr[i]; j++) {
             }
+            m->next[m->nentries++] = c;
+            w[s->n++] = (double)(j - i) * (c ? 1.0 + MARKOV_BIAS * weak[c] : 1.0);
+            i = j;
+        }
+        markov_alias(m, s->first, s->n, w, small, large);
+        m->state_of[st] = (uint32_t)++m->nstates;
+    }
+    free(tr);
+    free(w);
+    free(small);
+    free(large);
+}
 
-            free(typed);
+static void markov_free(Markov *m) {
+    free(m->state_of);
+    free(m->states);
+    free(m->next);
+    free(m->prob);
+    free(m->alias);
+    memset(m, 0, sizeof(*m));
+}
 
-            // Add to global mistakes
-            for (size_t j = 0; j < item_mwords.n; j++) {
-                map_add(mwords, item_mwords.items[j].key, item_mwords.items[j].count);
-            }
-            map_free(&item_mwords);
+static uint64_t markov_rand(Markov *m) {
+    m->rng ^= m->rng >> 12;
+    m->rng ^= m->rng << 25;
+    m->rng ^= m->rng >> 27;
+    return m->rng * 0x2545F4914F6CDD1Dull;
+}
+
+// Ein Wort ziehen (UTF-8 in out, mindestens 2 * MARKOV_MAX_LEN + 1 Bytes), Rückgabe Länge in Bytes
+static size_t markov_draw(Markov *m, char *out) {
+    uint32_t st = 0;
+    size_t len = 0, chars = 0;
+    while (chars < MARKOV_MAX_LEN) {
+        uint32_t si = m->state_of[st];
+        const MarkovState *s;
+        uint64_t r;
+        uint32_t e;
+        unsigned char c;
+        if (si == 0) break;
+        s = &m->states[si - 1];
+        r = markov_rand(m);
+        // obere 32 Bit wählen den Eintrag, untere 32 Bit entscheiden gegen den Alias
+        e = (uint32_t)(((r >> 32) * s->n) >> 32);
+        if ((uint32_t)r > m->prob[s->first + e]) e = m->alias[s->first + e];
+        c = m->next[s->first + e];
+        if (c == 0) break;
+        if (c < 0x80) {
+            out[len++] = (char)c;
+        } else {
+            out[len++] = (char)(0xC0 | (c >> 6));
+            out[len++] = (char)(0x80 | (c & 0x3F));
         }
+        chars++;
+        st = (st << 8 | c) & 0xFFFF;
+    }
+    out[len] = '\0';
+    return chars;
+}
 
-        {
-            double minutes_total = total_seconds / 60.0;
-            double gross_wpm_total = 0.0;
-            double accuracy_total = 0.0;
+// Neues Übungswort: mindestens MARKOV_MIN_LEN Zeichen und (wenn möglich) nicht schon im Sprachpaket
+static const char *markov_word(Markov *m, char *out) {
+    int t;
+    for (t = 0; t < MARKOV_TRIES; t++) {
+        if (markov_draw(m, out) >= MARKOV_MIN_LEN && lang_word_id(&lang, out) < 0) break;
+    }
+    return out;
+}
 
-            if (minutes_total > 0.0) {
-                gross_wpm_total = ((double)total_chars_typed / 5.0) / minutes_total; // WPM: durch 5 teilen, da 1 Wort = 5 Zeichen (Standarddefinition für Tippgeschwindigkeit)
-            }
-            if (total_chars_typed > 0) {
-                accuracy_total = ((double)total_correct_chars / (double)total_chars_typed) * 100.0; //Anteil der korrekten Zeichen von alle geschriebenen Zeichen
-            }
+// Übung mit generierten Wörtern, die die schwachen Zeichen häufen
+static void generated_practice(Map *mwords, Map *mchars) {
+    char word[2 * MARKOV_MAX_LEN + 1];
+    char header[64];
+    char *s;
+    int n;
+    int i;
+    SessionTotals tot;
+
+    printf("How many words? (e.g. 10): ");
+    s = read_line();
+    if (s == NULL) return;
+    n = atoi(s);
+    free(s);
+    if (n <= 0) n = 10;
+
+    markov_build(&markov, mchars, ((uint64_t)time(NULL) << 16) ^ (uint64_t)rand());
+    memset(&tot, 0, sizeof(tot));
+    tot.mode = "generated";
+    for (i = 0; i < n; i++) {
+        markov_word(&markov, word);
+        snprintf(header, sizeof(header), "Generated %d/%d", i + 1, n);
+        if (!practice_item(word, NULL, header, mwords, mchars, &tot)) break;
+    }
+    markov_free(&markov);
+    if (tot.items > 0) finish_session(&tot, mwords, mchars);
+}
 
-            printf("\n=== Session Summary ===\n");
-            printf("Items: %d  Total time: %.2fs  Total chars typed: %zu\n", n, total_seconds, total_chars_typed);
-            printf("Gross WPM: %.2f   Accuracy: %.2f%%\n", gross_wpm_total, accuracy_total);
+// --generate N: N Wörter ausgeben, Dauer auf stderr. Die Wörter werden blockweise erzeugt und dann
+// geschrieben, so lässt sich die reine Erzeugung getrennt von der Ausgabe messen.
+#define MARKOV_BATCH 4096
 
-            append_session_stats(gross_wpm_total, accuracy_total, (long)total_chars_typed);
-            save_map_to_file(mwords, MWORDS_FILE);
-            save_map_to_file(mchars, MCHARS_FILE);
-            printf("Session saved.\n");
+static int markov_generate(long n, const Map *mchars) {
+    static char batch[MARKOV_BATCH * (2 * MARKOV_MAX_LEN + 2)];
+    struct timeval start, end, t0, t1;
+    double gen_secs = 0.0;
+    double secs;
+    long i = 0;
+    markov_build(&markov, mchars, (uint64_t)time(NULL));
+    gettimeofday(&start, NULL);
+    while (i < n) {
+        size_t len = 0;
+        long k;
+        gettimeofday(&t0, NULL);
+        for (k = 0; k < MARKOV_BATCH && i < n; k++, i++) {
+            len += strlen(markov_word(&markov, batch + len));
+            batch[len++] = '\n';
         }
+        gettimeofday(&t1, NULL);
+        gen_secs += elapsed_seconds(t0, t1);
+        fwrite(batch, 1, len, stdout);
     }
+    fflush(stdout);
+    gettimeofday(&end, NULL);
+    secs = elapsed_seconds(start, end);
+    fprintf(stderr, "%ld words: generation %.3fs (%.0f words/s), %.3fs including output\n",
+            n, gen_secs, gen_secs > 0.0 ? n / gen_secs : 0.0, secs);
+    markov_free(&markov);
+    return 0;
 }
 
 // Trainingsmodus: Übe die am häufigsten falsch getippten Wörter/Buchstaben
@@ -585,7 +6344,8 @@ static void training_mode(Map *mwords, Map *mchars) {
         return;
     }
 
-    printf("Focus options:\n1) Mistyped words\n2) Mistyped characters\nEnter choice: ");
+    printf("Focus options:\n1) Mistyped words\n2) Mistyped characters\n3) Spaced repetition review (due words)\n"
+           "4) New generated words for weak characters\nEnter choice: ");
     c = read_line();
     if (c == NULL) return;
     //Convert String zu einem int
@@ -593,11 +6353,16 @@ static void training_mode(Map *mwords, Map *mchars) {
     //Free C da Heap speicher
     free(c);
 
-    if (choice == 1 && mwords->n > 0) { //mistyped words
+    if (choice == 3 && mwords->n > 0) {
+        srs_review(mwords, mchars);
+    } else if (choice == 4 && mchars->n > 0) {
+        generated_practice(mwords, mchars);
+    } else if (choice == 1 && mwords->n > 0) { //mistyped words
         KeyCount *copy;
         size_t i;
         int n;
         char *s;
+        char num[32];
         int rounds;
         int r;
 
@@ -616,7 +6381,7 @@ static void training_mode(Map *mwords, Map *mchars) {
         n = (mwords->n < TOP_N) ? (int)mwords->n : TOP_N;
         printf("Top %d mistyped words:\n", n);
         for (i = 0; i < (size_t)n; i++) {
-            printf("  %d) %s (%ld)\n", (int)i + 1, copy[i].key, copy[i].count);
+            printf("  %d) %s (%s)\n", (int)i + 1, copy[i].key, map_count_text(mwords, copy[i].count, num, sizeof(num)));
         }
 
         printf("How many rounds through the list? (e.g. 3): ");
@@ -634,45 +6399,27 @@ static void training_mode(Map *mwords, Map *mchars) {
         for (r = 0; r < rounds; r++) {
             for (i = 0; i < (size_t)n; i++) {
                 const char *ref = copy[i].key;
-                char *tmp;
-                char *typed;
+                const char *typed;
                 struct timeval start, end; //#include <sys/time.h>, time liefert nur Mikrosekunden, timeval ist ein Struct mit time_t tv_sec und susseconds_t tv_usec
-                double secs, minutes, gross_wpm, accuracy;
+                double secs, gross_wpm, accuracy;
                 CompareResult cres;
 
+                arena_reset(&item_arena);
                 printf("\n%s\nPress ENTER when ready...", ref);
-                tmp = read_line();
-                //free tmp wenn ungleich null da durch read_line ein malloc durchgeführt wurde, die Nummer wird nicht mehr benötigt
-                if (tmp != NULL) free(tmp);
+                read_line_tmp();
 
                 printf("Type: ");
                 gettimeofday(&start, NULL); //#include <sys/time.h>, time liefert nur Mikrosekunden, timeval ist ein Struct mit time_t tv_sec und susseconds_t tv_usec;
-                typed = read_line();
+                typed = read_typed("Training", ref);
                 gettimeofday(&end, NULL); //#include <sys/time.h>, time liefert nur Mikrosekunden, timeval ist ein Struct mit time_t tv_sec und susseconds_t tv_usec;
                 //Weil bei Typed == NULL würde das Programm beendet werden, wenn der User z.B. nur Enter drückt
-                if (typed == NULL) {
-                    typed = (char*)malloc(1);
-                    if (typed == NULL) { printf("Fehler bei malloc\n"); exit(1); }
-                    typed[0] = '\0';
-                }
+                if (typed == NULL) typed = "";
 
-                cres = compare_and_update(ref, typed, mwords, mchars);
+                cres = compare_and_update(&item_arena, ref, NULL, typed, mwords, mchars);
                 secs = elapsed_seconds(start, end);
-                minutes = secs / 60.0;
-                if (minutes > 0.0) {
-                    gross_wpm = ((double)strlen(typed) / 5.0) / minutes; //double da Kommazahlen, /5 da Standardwert für ein Wort
-                } else {
-                    gross_wpm = 0.0;
-                }
-                if (strlen(typed) > 0) {
-                    accuracy = ((double)cres.correct_chars / (double)strlen(typed)) * 100.0;
-                } else {
-                    accuracy = 0.0;
-                }
+                item_scores(strlen(typed), cres.correct_chars, secs, &gross_wpm, &accuracy);
                 //%.2f = 2 Kommastellen, %zu Format Specifier für einen size_t, %% für escaped % Zeichen
                 printf("  Result: Time %.2fs  WPM %.2f  Accuracy %.2f%%\n",secs, gross_wpm, accuracy);
-
-                free(typed);
             }
         }
         free(copy);
@@ -684,6 +6431,7 @@ static void training_mode(Map *mwords, Map *mchars) {
         size_t i;
         int n;
         char *s;
+        char num[32];
         int reps;
 
         //Copy um nicht die eigentliche Datenstruktur anzupassen
@@ -701,7 +6449,7 @@ static void training_mode(Map *mwords, Map *mchars) {
         n = (mchars->n < TOP_N) ? (int)mchars->n : TOP_N;
         printf("Top %d mistyped chars:\n", n);
         for (i = 0; i < (size_t)n; i++) {
-            printf("  %d) '%s' (%ld)\n", (int)i + 1, copy[i].key, copy[i].count);
+            printf("  %d) '%s' (%s)\n", (int)i + 1, copy[i].key, map_count_text(mchars, copy[i].count, num, sizeof(num)));
         }
         
         printf("How many repetitions per char? (e.g. 5): ");
@@ -718,22 +6466,16 @@ static void training_mode(Map *mwords, Map *mchars) {
         for (i = 0; i < (size_t)n; i++) {
             char target = copy[i].key[0];
             int r;
-            char *tmp;
             printf("\nPractice character '%c' (%d times). Press ENTER when ready...", target, reps);
-            //free tmp wenn ungleich null da durch read_line ein malloc durchgeführt wurde, die Nummer wird nicht mehr benötigt
-            tmp = read_line();
-            
-            if (tmp != NULL) free(tmp);
+            read_line_tmp();
 
             for (r = 0; r < reps; r++) {
-                char *typed;
+                const char *typed;
                 printf("Type '%c': ", target);
-                typed = read_line();
+                typed = read_line_tmp();
                 if (typed == NULL) {
                     //Weil bei Typed == NULL würde das Programm beendet werden, wenn der User z.B. nur Enter drückt
-                    typed = (char*)malloc(1);
-                    if (typed == NULL) { printf("Fehler bei malloc\n"); exit(1); }
-                    typed[0] = '\0';
+                    typed = "";
                 }
                 if (typed[0] != target) {
                     map_add_char(mchars, target, 1);
@@ -741,7 +6483,6 @@ static void training_mode(Map *mwords, Map *mchars) {
                 } else {
                     printf("  Correct.\n");
                 }
-                free(typed);
             }
         }
 
@@ -754,12 +6495,479 @@ static void training_mode(Map *mwords, Map *mchars) {
     }
 }
 
+// ---------- Synthetischer Tipper (Lasttest ohne Mensch) ----------
+// Erzeugt aus den Wort- und Satzbänken getippte Zeilen mit Tippfehlern und Anschlagzeiten und
+// schickt sie durch dieselbe Auswertung wie echte Eingaben (LiveScore, compare_and_update, Maps).
+// Mit gleichem Seed ist der Lauf bitgenau reproduzierbar, daher auch als Regressionstest brauchbar.
+
+typedef struct {
+    uint64_t state;         // splitmix64
+    double wpm_mean;
+    double wpm_sd;
+    double p_sub;           // Wahrscheinlichkeiten pro Referenzzeichen
+    double p_ins;
+    double p_del;
+    double p_swap;
+    char *typed;            // getippte Bytes des letzten Items (wiederverwendet)
+    double *times;          // Sekunden seit Start des Items pro Byte
+    size_t cap;
+    char (*alpha)[5];       // Zeichen des Sprachpakets (UTF-8, nullterminiert) für Tippfehler
+    size_t alpha_n;
+} SynthTypist;
+
+static uint64_t synth_next(SynthTypist *s) {
+    uint64_t z = (s->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// gleichverteilt in [0, 1)
+static double synth_uniform(SynthTypist *s) {
+    return (double)(synth_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// annähernd standardnormalverteilt (Summe von 4 Gleichverteilten, ohne libm)
+static double synth_normal(SynthTypist *s) {
+    double sum = synth_uniform(s) + synth_uniform(s) + synth_uniform(s) + synth_uniform(s);
+    return (sum - 2.0) * 1.7320508075688772;
+}
+
+static void synth_init(SynthTypist *s, uint64_t seed) {
+    memset(s, 0, sizeof(*s));
+    s->state = seed;
+    s->wpm_mean = 45.0;
+    s->wpm_sd = 12.0;
+    s->p_sub = 0.02;
+    s->p_ins = 0.005;
+    s->p_del = 0.005;
+    s->p_swap = 0.005;
+}
+
+static void synth_free(SynthTypist *s) {
+    free(s->typed);
+    free(s->times);
+    free(s->alpha);
+    s->typed = NULL;
+    s->times = NULL;
+    s->alpha = NULL;
+    s->cap = 0;
+    s->alpha_n = 0;
+}
+
+// Alphabet für falsche Zeichen: alle verschiedenen Zeichen der Wörter des Pakets (ohne Leerzeichen),
+// bei einem Paket ohne Wörter 'a'..'z'
+static void synth_alphabet(SynthTypist *s, const LangPack *pack) {
+    size_t cap = 64;
+    size_t w, i, k;
+    s->alpha_n = 0;
+    s->alpha = realloc(s->alpha, cap * sizeof(*s->alpha));
+    if (s->alpha == NULL) {
+        printf("Fehler bei malloc\n");
+        exit(1);
+    }
+    for (w = 0; w < pack->nwords; w++) {
+        const char *word = pack->words[w];
+        for (i = 0; word[i] != '\0'; ) {
+            size_t l = utf8_len((unsigned char)word[i]);
+            char c[5] = {0};
+            for (k = 0; k < l && word[i + k] != '\0'; k++) c[k] = word[i + k];
+            i += k;
+            if (c[0] == ' ') continue;
+            for (k = 0; k < s->alpha_n && strcmp(s->alpha[k], c) != 0; k++);
+            if (k < s->alpha_n) continue;
+            if (s->alpha_n == cap) {
+                cap *= 2;
+                s->alpha = realloc(s->alpha, cap * sizeof(*s->alpha));
+                if (s->alpha == NULL) {
+                    printf("Fehler bei malloc\n");
+                    exit(1);
+                }
+            }
+            memcpy(s->alpha[s->alpha_n++], c, sizeof(c));
+        }
+    }
+    if (s->alpha_n == 0) {
+        for (k = 0; k < 26; k++) {
+            s->alpha[k][0] = (char)('a' + k);
+            s->alpha[k][1] = '\0';
+        }
+        s->alpha_n = 26;
+    }
+}
+
+// Zeichen (len Bytes) mit Zeitstempel anhängen; *t läuft um einen zufällig gestreuten Anschlagabstand
+// weiter, alle Bytes eines Zeichens kommen mit demselben Anschlag
+static void synth_emit(SynthTypist *s, size_t *n, const char *ch, size_t len, double *t, double interval) {
+    double jitter = 1.0 + 0.25 * synth_normal(s);
+    size_t k;
+    if (jitter < 0.3) jitter = 0.3;
+    *t += interval * jitter;
+    for (k = 0; k < len; k++) {
+        s->typed[*n] = ch[k];
+        s->times[*n] = *t;
+        (*n)++;
+    }
+}
+
+// zufälliges Zeichen aus dem Alphabet, das nicht ch (len Bytes) ist
+static const char *synth_wrong(SynthTypist *s, const char *ch, size_t len) {
+    size_t k = (size_t)(synth_next(s) % s->alpha_n);
+    if (s->alpha_n > 1 && strlen(s->alpha[k]) == len && memcmp(s->alpha[k], ch, len) == 0) {
+        k = (k + 1) % s->alpha_n;
+    }
+    return s->alpha[k];
+}
+
+// ref "tippen": Ergebnis in s->typed (nullterminiert) und s->times, Rückgabe Anzahl Bytes.
+// Pro Item wird eine Geschwindigkeit gezogen; Fehler (Ersetzen, Einfügen, Auslassen, Vertauschen)
+// wirken auf ganze UTF-8 Zeichen, falsche Zeichen kommen aus s->alpha (synth_alphabet vorher aufrufen)
+static size_t synth_type(SynthTypist *s, const char *ref) {
+    size_t rlen = strlen(ref);
+    size_t need = 5 * rlen + 1;   // pro Referenzbyte höchstens das Zeichen selbst und ein eingefügtes (<= 4 Bytes)
+    size_t i = 0, n = 0;
+    double wpm = s->wpm_mean + s->wpm_sd * synth_normal(s);
+    double interval;
+    double t = 0.0;
+
+    if (need > s->cap) {
+        char *typed = realloc(s->typed, need);
+        double *times = realloc(s->times, need * sizeof(double));
+        if (typed == NULL || times == NULL) {
+            printf("Fehler bei malloc\n");
+            exit(1);
+        }
+        s->typed = typed;
+        s->times = times;
+        s->cap = need;
+    }
+    if (wpm < 5.0) wpm = 5.0;
+    interval = 60.0 / (wpm * 5.0);   // Sekunden pro Zeichen, 5 Zeichen = 1 Wort
+    while (i < rlen) {
+        double r = synth_uniform(s);
+        const char *ch = ref + i;
+        size_t len = utf8_len((unsigned char)*ch);
+        if (len > rlen - i) len = rlen - i;
+        if (r < s->p_sub) {
+            const char *wrong = synth_wrong(s, ch, len);
+            synth_emit(s, &n, wrong, strlen(wrong), &t, interval);
+            i += len;
+        } else if ((r -= s->p_sub) < s->p_del) {
+            i += len;
+        } else if ((r -= s->p_del) < s->p_ins) {
+            const char *extra = s->alpha[synth_next(s) % s->alpha_n];
+            synth_emit(s, &n, ch, len, &t, interval);
+            synth_emit(s, &n, extra, strlen(extra), &t, interval);
+            i += len;
+        } else if ((r -= s->p_ins) < s->p_swap && i + len < rlen) {
+            size_t len2 = utf8_len((unsigned char)ref[i + len]);
+            if (len2 > rlen - i - len) len2 = rlen - i - len;
+            synth_emit(s, &n, ref + i + len, len2, &t, interval);
+            synth_emit(s, &n, ch, len, &t, interval);
+            i += len + len2;
+        } else {
+            synth_emit(s, &n, ch, len, &t, interval);
+            i += len;
+        }
+    }
+    s->typed[n] = '\0';
+    return n;
+}
+
+// Sekunden seit einem festen Zeitpunkt, für die Messung der Laufzeit
+static double bench_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// items synthetische Items (Wörter oder Sätze der gewählten Sprache) auswerten und Durchsatz ausgeben.
+// save: Fehler-Maps und Tastenstatistik aus dem Arbeitsverzeichnis laden und am Ende wie eine
+// normale Session speichern (Persistenz mitmessen, ohne Eintrag in stats.txt und Rangliste);
+// sonst wird keine Datei angefasst.
+static int bench_run(SynthTypist *s, long items, int sentences, int save, long top_k) {
+    Map mwords;
+    Map mchars;
+    SessionTotals tot;
+    LiveScore live;
+    size_t keys = 0;
+    double start, scored, gross_wpm, accuracy;
+    long it;
+
+    if ((sentences && lang.sentence_n == 0) || (!sentences && lang.bank_n == 0)) {
+        printf("Language pack has no %s.\n", sentences ? "sentences" : "words");
+        return 1;
+    }
+    memset(&tot, 0, sizeof(tot));
+    tot.mode = sentences ? "bench-sentences" : "bench-words";
+    synth_alphabet(s, &lang);
+    map_init(&mwords);
+    map_init(&mchars);
+    if (top_k > 0) map_set_limit(&mwords, (size_t)top_k);
+    if (save) {
+        load_map_from_file(&mwords, MWORDS_FILE);
+        load_map_from_file(&mchars, MCHARS_FILE);
+        key_stats_load();
+        ngram_load();
+        confusion_load();
+    }
+    map_use_pack(&mwords, &lang);
+    if (decay_half_life >= 0.0) map_set_decay(&mwords, decay_half_life);
+    if (decay_half_life >= 0.0) map_set_decay(&mchars, decay_half_life);
+    metrics_words = &mwords;
+    metrics_chars = &mchars;
+
+    start = bench_clock();
+    for (it = 0; it < items; it++) {
+        const char *ref;
+        const int32_t *ref_ids;
+        int32_t word_id;
+        size_t n, k;
+        CompareResult cres;
+
+        if (sentences) {
+            const LangSentence *ls = &lang.sentences[synth_next(s) % lang.sentence_n];
+            ref = ls->text;
+            ref_ids = ls->ids;
+        } else {
+            word_id = lang.bank[synth_next(s) % lang.bank_n];
+            ref = lang.words[word_id];
+            ref_ids = &word_id;
+        }
+        n = synth_type(s, ref);
+
+        arena_reset(&item_arena);
+        live_score_init(&live, ref);
+        for (k = 0; k < n; k++) live_score_key(&live, (unsigned char)s->typed[k], s->times[k]);
+        keys += n;
+
+        cres = compare_and_update(&item_arena, ref, ref_ids, s->typed, &mwords, &mchars);
+        tot.items++;
+        tot.chars_typed += n;
+        tot.correct_chars += cres.correct_chars;
+        tot.words += cres.total_words;
+        tot.correct_words += cres.correct_words;
+        tot.seconds += (n > 0) ? s->times[n - 1] : 0.0;
+    }
+    scored = bench_clock();
+
+    item_scores(tot.chars_typed, tot.correct_chars, tot.seconds, &gross_wpm, &accuracy);
+    printf("Items: %d  Keys: %zu  Words: %zu (%zu correct)\n", tot.items, keys, tot.words, tot.correct_words);
+    printf("Simulated: %.2fs  Gross WPM: %.2f  Accuracy: %.2f%%\n", tot.seconds, gross_wpm, accuracy);
+    printf("Distinct mistakes: %zu words, %zu chars\n", mwords.n, mchars.n);
+    printf("Scoring: %.3fs  %.0f items/s  %.0f keys/s\n", scored - start,
+           (scored > start) ? (double)tot.items / (scored - start) : 0.0,
+           (scored > start) ? (double)keys / (scored - start) : 0.0);
+
+    if (save) {
+        finish_session(&tot, &mwords, &mchars);
+        printf("Saving: %.3fs\n", bench_clock() - scored);
+    }
+    metrics_write();
+    metrics_words = metrics_chars = NULL;
+    map_free(&mwords);
+    map_free(&mchars);
+    return 0;
+}
+
 // Hauptprogrammschleife
-int main(void) {
+int main(int argc, char **argv) {
     Map mistakes_words;
     Map mistakes_chars;
     char *choice;
     int c;
+    int a;
+    int no_live = 0;
+    int stats_mode = 0;
+    time_t since = (time_t)-1;
+    time_t until = (time_t)-1;
+    int gran = ROLLUP_DAY;
+    int archive_mode = 0;
+    const char *lang_name = NULL;
+    long top_k = 0;
+    long bench_items = 0;
+    int bench_sentences = 0;
+    int bench_save = 0;
+    int board_top = 0;
+    int worst_n = 0;
+    long generate_n = 0;
+    const char *env;
+    SynthTypist synth;
+    time_t before = time(NULL) - (time_t)ARCHIVE_KEEP_DAYS * 86400;
+
+    layouts_init();
+    synth_init(&synth, 1);
+    metrics_start = time(NULL);
+    env = getenv("TT_LEADERBOARD");
+    if (env != NULL && *env) board_path = env;
+    env = getenv("USER");
+    if (env == NULL || !*env) env = getenv("USERNAME");
+    if (env != NULL && *env) snprintf(board_user, sizeof(board_user), "%s", env);
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--no-live") == 0) {
+            no_live = 1;
+        } else if (strcmp(argv[a], "--merge-sketches") == 0 && a + 2 < argc) {
+            return merge_sketch_files(argv[a + 1], argv + a + 2, argc - a - 2);
+        } else if (strcmp(argv[a], "--merge-mistakes") == 0 && a + 2 < argc) {
+            return merge_mistake_files(argv[a + 1], argv + a + 2, argc - a - 2);
+        } else if (strcmp(argv[a], "--events") == 0 && a + 1 < argc) {
+            return events_report(argv + a + 1, argc - a - 1);
+        } else if (strcmp(argv[a], "--stats") == 0) {
+            stats_mode = 1;
+        } else if ((strcmp(argv[a], "--since") == 0 || strcmp(argv[a], "--until") == 0) && a + 1 < argc) {
+            time_t t = parse_iso_time(argv[a + 1]);
+            if (t == (time_t)-1) {
+                printf("Invalid date: %s (expected YYYY-MM-DD)\n", argv[a + 1]);
+                return 1;
+            }
+            if (argv[a][2] == 's') {
+                since = t;
+            } else {
+                // bis einschliesslich: reines Datum meint das Ende des Tages
+                until = (strchr(argv[a + 1], 'T') != NULL) ? t : t + 86399;
+            }
+            a++;
+        } else if (strcmp(argv[a], "--top-k") == 0 && a + 1 < argc) {
+            top_k = atol(argv[++a]);
+            if (top_k <= 0) {
+                printf("Invalid --top-k value: %s\n", argv[a]);
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--bench") == 0 && a + 1 < argc) {
+            bench_items = atol(argv[++a]);
+            if (bench_items <= 0) {
+                printf("Invalid --bench value: %s\n", argv[a]);
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--seed") == 0 && a + 1 < argc) {
+            synth.state = strtoull(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "--wpm") == 0 && a + 1 < argc) {
+            // MEAN oder MEAN:SD
+            int got = sscanf(argv[++a], "%lf:%lf", &synth.wpm_mean, &synth.wpm_sd);
+            if (got < 1 || synth.wpm_mean <= 0.0 || synth.wpm_sd < 0.0) {
+                printf("Invalid --wpm value: %s (expected MEAN[:SD])\n", argv[a]);
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--typos") == 0 && a + 1 < argc) {
+            // Raten pro Zeichen: Ersetzen, Einfügen, Auslassen, Vertauschen
+            if (sscanf(argv[++a], "%lf,%lf,%lf,%lf", &synth.p_sub, &synth.p_ins, &synth.p_del, &synth.p_swap) != 4 ||
+                synth.p_sub < 0.0 || synth.p_ins < 0.0 || synth.p_del < 0.0 || synth.p_swap < 0.0 ||
+                synth.p_sub + synth.p_ins + synth.p_del + synth.p_swap > 1.0) {
+                printf("Invalid --typos value: %s (expected SUB,INS,DEL,SWAP rates summing to <= 1)\n", argv[a]);
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--leaderboard") == 0) {
+            board_top = 10;
+            if (a + 1 < argc && isdigit((unsigned char)argv[a + 1][0])) board_top = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--generate") == 0 && a + 1 < argc) {
+            generate_n = atol(argv[++a]);
+            if (generate_n <= 0) {
+                printf("Invalid --generate value: %s\n", argv[a]);
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--decay") == 0 && a + 1 < argc) {
+            // Halbwertszeit der Fehlerzähler in Tagen, 0 = Verfall ausschalten (bleibt in den Dateien gespeichert)
+            // auf ganze Sekunden wie in der Datei, sonst gälte jede gespeicherte Halbwertszeit als geändert
+            decay_half_life = (double)(long long)(atof(argv[++a]) * 86400.0 + 0.5);
+            if (decay_half_life < 0.0) {
+                printf("Invalid --decay value: %s\n", argv[a]);
+                return 1;
+            }
+        } else if (strcmp(argv[a], "--verify") == 0) {
+            snap_verify = 1;
+        } else if (strcmp(argv[a], "--metrics") == 0 && a + 1 < argc) {
+            metrics_path = argv[++a];
+        } else if (strcmp(argv[a], "--worst-transitions") == 0) {
+            worst_n = TOP_N;
+            if (a + 1 < argc && isdigit((unsigned char)argv[a + 1][0])) worst_n = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--board") == 0 && a + 1 < argc) {
+            board_path = argv[++a];
+        } else if (strcmp(argv[a], "--user") == 0 && a + 1 < argc) {
+            snprintf(board_user, sizeof(board_user), "%s", argv[++a]);
+        } else if (strcmp(argv[a], "--sentences") == 0) {
+            bench_sentences = 1;
+        } else if (strcmp(argv[a], "--save") == 0) {
+            bench_save = 1;
+        } else if (strcmp(argv[a], "--lang") == 0 && a + 1 < argc) {
+            lang_name = argv[++a];
+        } else if (strcmp(argv[a], "--layout") == 0 && a + 1 < argc) {
+            if (!layout_select(argv[a + 1])) {
+                printf("Unknown layout: %s (qwertz, qwerty or dvorak)\n", argv[a + 1]);
+                return 1;
+            }
+            a++;
+        } else if (strcmp(argv[a], "--archive-stats") == 0) {
+            archive_mode = 1;
+        } else if (strcmp(argv[a], "--before") == 0 && a + 1 < argc) {
+            before = parse_iso_time(argv[a + 1]);
+            if (before == (time_t)-1) {
+                printf("Invalid date: %s (expected YYYY-MM-DD)\n", argv[a + 1]);
+                return 1;
+            }
+            a++;
+        } else if (strcmp(argv[a], "--group-by") == 0 && a + 1 < argc) {
+            for (gran = 0; gran < ROLLUP_COUNT; gran++) {
+                if (strcmp(argv[a + 1], rollup_names[gran]) == 0) break;
+            }
+            if (gran == ROLLUP_COUNT) {
+                printf("Invalid group: %s (day, week or month)\n", argv[a + 1]);
+                return 1;
+            }
+            a++;
+        } else {
+            printf("Unknown option: %s\n", argv[a]);
+            printf("Usage: %s [--no-live] [--lang de|en] [--layout qwertz|qwerty|dvorak] [--top-k K] [--decay DAYS] [--metrics FILE] [--verify]\n"
+                   "       %s --merge-sketches OUT IN... | --merge-mistakes OUT IN...\n"
+                   "       %s --stats [--since YYYY-MM-DD] [--until YYYY-MM-DD] [--group-by day|week|month]\n"
+                   "       %s --archive-stats [--before YYYY-MM-DD]\n"
+                   "       %s --events FILE... | --worst-transitions [N] | --generate N\n"
+                   "       %s --leaderboard [N]   (any mode: [--board PATH] [--user NAME])\n"
+                   "       %s --bench N [--seed S] [--wpm MEAN[:SD]] [--typos SUB,INS,DEL,SWAP] [--sentences] [--save]\n",
+                   argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (archive_mode) {
+        return archive_stats(before);
+    }
+    if (board_top > 0) {
+        return board_show(board_top);
+    }
+    if (worst_n > 0) {
+        ngram_load();
+        if (ngram_bi == NULL) printf("No transitions recorded yet.\n");
+        show_worst_transitions(worst_n);
+        return 0;
+    }
+    if (!lang_init(lang_name)) {
+        printf("Unknown language: %s (de or en)\n", lang_name);
+        return 1;
+    }
+    if (stats_mode) {
+        return stats_query(since, until, gran);
+    }
+    if (generate_n > 0) {
+        Map chars;
+        int rc;
+        map_init(&chars);
+        load_map_from_file(&chars, MCHARS_FILE);
+        rc = markov_generate(generate_n, &chars);
+        map_free(&chars);
+        return rc;
+    }
+    if (bench_items > 0) {
+        int rc = bench_run(&synth, bench_items, bench_sentences, bench_save, top_k);
+        synth_free(&synth);
+        return rc;
+    }
+
+    // Live-Ansicht nur wenn interaktiv an einem Terminal getippt wird
+    if (!no_live && isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)) {
+        live_view = 1;
+        atexit(term_restore);
+        signal(SIGINT, term_signal);
+        signal(SIGTERM, term_signal);
+    }
 
     //Immer andere Reihenfolge, das s Rand mit der aktuellen Uhrzeit seit 1970 immer einen anderen Startpunkt setzt (srand erwartet einen unsigend int deshalb das Parsing)
     srand((unsigned)time(NULL));
@@ -767,8 +6975,19 @@ int main(void) {
     map_init(&mistakes_words);
     map_init(&mistakes_chars);
 
+    // Wortfehler mit festem Speicher: die Grenze gilt schon beim Laden
+    if (top_k > 0) map_set_limit(&mistakes_words, (size_t)top_k);
     load_map_from_file(&mistakes_words, MWORDS_FILE);
     load_map_from_file(&mistakes_chars, MCHARS_FILE);
+    map_use_pack(&mistakes_words, &lang);
+    if (decay_half_life >= 0.0) map_set_decay(&mistakes_words, decay_half_life);
+    if (decay_half_life >= 0.0) map_set_decay(&mistakes_chars, decay_half_life);
+    metrics_words = &mistakes_words;
+    metrics_chars = &mistakes_chars;
+    key_stats_load();
+    ngram_load();
+    confusion_load();
+    wal_recover(&mistakes_words, &mistakes_chars);
 
     while (1) {
         printf("\n=== TypingTrainer - Type-Celerate ===\n");
@@ -798,8 +7017,18 @@ int main(void) {
         }
     }
 
-    save_map_to_file(&mistakes_words, MWORDS_FILE);
-    save_map_to_file(&mistakes_chars, MCHARS_FILE);
+    {
+        uint64_t t0 = metric_now_ns();
+        save_map_to_file(&mistakes_words, MWORDS_FILE);
+        save_map_to_file(&mistakes_chars, MCHARS_FILE);
+        key_stats_save();
+        ngram_save();
+        confusion_save();
+        event_log_close();
+        metric_observe(MH_PERSIST, metric_now_ns() - t0);
+    }
+    metrics_write();
+    metrics_words = metrics_chars = NULL;
     map_free(&mistakes_words);
     map_free(&mistakes_chars);
 